@@ -12,10 +12,29 @@
                 "src/NodePopplerDocument.cc",
                 "src/NodePopplerPage.cc",
                 "src/iconv_string.cc",
-                "src/MemoryStream.cc"
+                "src/MemoryStream.cc",
+                "src/TiffStreamWriter.cc",
+                "src/JpegStreamWriter.cc",
+                "src/PngStreamWriter.cc",
+                "src/CostEstimator.cc",
+                "src/BitmapUtils.cc",
+                "src/RendererPool.cc",
+                "src/RenderBatch.cc",
+                "src/RenderThreadPool.cc",
+                "src/TileRender.cc",
+                "src/VariantRender.cc",
+                "src/RenderStream.cc",
+                "src/RenderCache.cc",
+                "src/Sha256.cc",
+                "src/DiskCache.cc",
+                "src/DraftOutputDev.cc",
+                "src/MappedFile.cc"
             ],
             "libraries": [
-                "<!@(pkg-config --libs poppler)"
+                "<!@(pkg-config --libs poppler)",
+                "-ltiff",
+                "-ljpeg",
+                "-lpng"
             ],
             "cflags": [
                 "<!@(pkg-config --cflags poppler)"
@@ -1,5 +1,7 @@
 /// <reference types="node" />
 
+import { Readable } from 'stream';
+
 /**
  * Represents an absolutely positioned rectangle on a page.
  *
@@ -96,13 +98,70 @@ export interface FileRenderResult {
  */
 export interface BufferRenderResult {
     type: 'buffer',
-    format: 'png' | 'jpeg' | 'tiff',
+    format: 'png' | 'jpeg' | 'tiff' | 'raw',
     /** Raw image data. */
     data: Buffer,
+    /** Width of the bitmap in pixels. Only for `raw` format. */
+    width?: number,
+    /** Height of the bitmap in pixels. Only for `raw` format. */
+    height?: number,
+    /** Length of a bitmap row in bytes (rows are padded to 4 bytes). Only for `raw` format. */
+    stride?: number,
+    /** Pixel layout of `data`. Only for `raw` format. */
+    pixelFormat?: PixelFormat,
 }
 
 export type RenderResult = FileRenderResult | BufferRenderResult
 
+/**
+ * Represents a result of a single page of a `renderPages` operation.
+ */
+export interface PageRenderResult extends BufferRenderResult {
+    /** Number of the rendered page. */
+    page: number,
+}
+
+/**
+ * Represents a single tile of a `renderTiles` operation.
+ */
+export interface TileRenderResult {
+    type: 'buffer' | 'file',
+    format: 'png' | 'jpeg' | 'tiff' | 'raw',
+    /** Index of the zoom level in `levels` option. */
+    level: number,
+    col: number,
+    row: number,
+    /** Position and size of the tile in the level bitmap, in pixels. */
+    x: number,
+    y: number,
+    width: number,
+    height: number,
+    /** Encoded tile, unless `path` option is given. */
+    data?: Buffer,
+    /** Tile file path if `path` option is given. */
+    path?: string,
+    /** Length of a tile row in bytes. Only for `raw` format. */
+    stride?: number,
+    /** Pixel layout of `data`. Only for `raw` format. */
+    pixelFormat?: PixelFormat,
+}
+
+/**
+ * Pixel layout for `raw` format.
+ *
+ * `rgb` - 3 bytes per pixel, `rgba` and `bgra` - 4 bytes per pixel
+ * with opaque alpha, `gray` - 1 byte per pixel.
+ */
+export type PixelFormat = 'rgb' | 'rgba' | 'bgra' | 'gray';
+
+/**
+ * Color mode a page is rendered and encoded in.
+ *
+ * `gray` - 8 bit grayscale, `mono` - 1 bit black and white. `mono` is
+ * not supported by `jpeg` format.
+ */
+export type ColorMode = 'rgb' | 'gray' | 'mono';
+
 /**
  * Compression method for `tiff` format.
  *
@@ -129,6 +188,15 @@ export type TiffCompression = 'none'
     | 'jp2000';
 
 
+/**
+ * Abort signal of a render, `AbortSignal` or anything shaped like it.
+ */
+export interface RenderAbortSignal {
+    readonly aborted: boolean,
+    addEventListener(type: 'abort', listener: () => any): void,
+    removeEventListener(type: 'abort', listener: () => any): void,
+}
+
 /**
  * Options for a render operation.
  */
@@ -145,15 +213,436 @@ export interface RenderOptions {
      * Progressive `jpeg`.
      */
     progressive?: boolean,
+    /**
+     * Chroma subsampling of `jpeg` (default `4:2:0`). `4:4:4` keeps color
+     * edges of text and line art sharp at the cost of size.
+     */
+    subsampling?: '4:2:0' | '4:2:2' | '4:4:4',
+    /**
+     * DCT used by the `jpeg` encoder (default `accurate`). `fast` is
+     * cheaper with slightly lower quality, fine for previews.
+     */
+    dctMethod?: 'accurate' | 'fast' | 'float',
+    /**
+     * Compute optimal Huffman tables for `jpeg`, a few percent smaller
+     * output for an extra pass over the image (default `false`).
+     */
+    optimize?: boolean,
+    /**
+     * Emit a `jpeg` restart marker every N MCU rows, 0 - 65535
+     * (default 0, no markers).
+     */
+    restartInterval?: number,
+    /**
+     * zlib compression level of `png`, 0 - 9. Lower levels encode faster
+     * into larger files.
+     */
+    compressionLevel?: number,
+    /**
+     * zlib strategy of `png`. `rle` and `huffman` are cheap and work well
+     * on flat text pages.
+     */
+    compressionStrategy?: 'default' | 'filtered' | 'huffman' | 'rle' | 'fixed',
+    /**
+     * Row filter of `png`. `none` is cheapest, `all` lets libpng choose
+     * per row.
+     */
+    filter?: 'none' | 'sub' | 'up' | 'average' | 'paeth' | 'all',
+    /**
+     * Write `png` as indexed color with at most 256 colors (default
+     * `false`). Pages with few colors, e.g. text, keep exact colors and
+     * use 1, 2 or 4 bit indices where possible; others are quantized.
+     * Requires `rgb` color mode. The palette is built from the whole
+     * image, so palette images are never banded: they are limited to
+     * 100M pixels and can't be combined with `bandHeight`.
+     */
+    palette?: boolean,
+    /**
+     * Rasterize and encode the image in bands of this many rows, so
+     * only one band is held in memory. Encoded images over 32M pixels
+     * are banded automatically and are not limited to 100M pixels like
+     * single bitmaps. Not supported by `raw` format.
+     */
+    bandHeight?: number,
     /**
      * Slice of a page to render instead of a full page.
      */
     slice?: Slice,
+    /**
+     * Pixel layout for `raw` format (default `rgb`).
+     */
+    pixelFormat?: PixelFormat,
+    /**
+     * Color mode of encoded formats (default `rgb`). Mono `tiff` uses
+     * `ccittfax4` compression unless `compression` is given, and CCITT
+     * compression methods require `mono`.
+     */
+    colorMode?: ColorMode,
+    /**
+     * Rasterizer preset. `fast` turns off vector and text anti-aliasing
+     * and turns on `draft`, trading quality for speed of previews and
+     * thumbnails. Options below override the preset.
+     */
+    preset?: 'default' | 'fast',
+    /**
+     * Anti-alias paths (default `true`).
+     */
+    vectorAntialias?: boolean,
+    /**
+     * Anti-alias glyphs (default `true`).
+     */
+    textAntialias?: boolean,
+    /**
+     * Drawing of lines thinner than a pixel (default `default`).
+     * Requires poppler 0.24 or newer.
+     */
+    thinLineMode?: 'default' | 'solid' | 'shape',
+    /**
+     * FreeType hinting of glyphs (default `none`).
+     */
+    hinting?: 'none' | 'slight' | 'full',
+    /**
+     * Decode JPEG images drawn much smaller than their size, e.g. scans
+     * in thumbnails, at 1/2, 1/4 or 1/8 scale instead of full resolution
+     * (default `false`). The scale is never below the size the image
+     * takes on the page.
+     */
+    draft?: boolean,
+    /**
+     * Aborts the render. Queued renders are dropped, running ones stop
+     * drawing, and the operation fails with an error with `code`
+     * `'ERR_RENDER_CANCELLED'`. Use `AbortSignal.timeout()` for a
+     * deadline. Synchronous renders could only be aborted before they
+     * start.
+     */
+    signal?: RenderAbortSignal,
+    /**
+     * Time budget of drawing the page in milliseconds. A render over
+     * the budget fails with an error with `code`
+     * `'ERR_RENDER_TIME_LIMIT'`. It is checked between content stream
+     * operations, so a single slow operation could overrun it.
+     */
+    maxRenderMs?: number,
+    /**
+     * Budget of content stream operations drawn, checked in steps of
+     * about ten operations. A render over the budget fails with an
+     * error with `code` `'ERR_RENDER_OPERATION_LIMIT'`.
+     */
+    maxOperations?: number,
 }
 
+/**
+ * One output of a `renderVariants` operation.
+ */
+export interface RenderVariant extends RenderOptions {
+    format: 'png' | 'jpeg' | 'tiff' | 'raw',
+    /** Resolution in pixels per inch. */
+    ppi: number,
+}
+
+/**
+ * Represents a single variant of a `renderVariants` operation.
+ */
+export interface VariantRenderResult extends BufferRenderResult {
+    /** Resolution of the variant. */
+    PPI: number,
+}
+
+/**
+ * Rendering cost of a page found by scanning its content. Counts are
+ * per drawing, e.g. a form drawn twice counts twice.
+ */
+export interface PageCost {
+    /** Content stream operators, including ones of drawn forms. */
+    operators: number,
+    /** Path construction operators (`m`, `l`, `c`, `v`, `y`, `h`, `re`). */
+    pathOperators: number,
+    /** Text showing operators (`Tj`, `TJ`, `'`, `"`). */
+    textOperators: number,
+    /** Smooth shadings painted with `sh`. */
+    shadings: number,
+    /** Drawn images, inline ones included. */
+    images: number,
+    /** Decoded pixels of drawn images and their soft masks. */
+    imagePixels: number,
+    /** Distinct fonts in page and form resources. */
+    fonts: number,
+    /** Transparency group forms and soft masks. */
+    transparencyGroups: number,
+    /** Pixels of a full page render at the given PPI. */
+    outputPixels: number,
+}
+
+/**
+ * Source of output buffers, e.g. a `BufferPool`.
+ */
+export interface OutputBufferPool {
+    /** Returns a buffer for the next render. */
+    acquire(): Buffer,
+}
+
+/**
+ * Options for a render to a buffer.
+ */
+export interface BufferRenderOptions extends RenderOptions {
+    /**
+     * Buffer to write the result into, or a pool to take one from. The
+     * result `data` is a slice of it, so no buffer is allocated for the
+     * output. Don't touch the buffer until the render is done.
+     */
+    output?: Buffer | OutputBufferPool,
+    /**
+     * Return results which don't fit into `output` in a newly allocated
+     * buffer. Otherwise the render fails with `ERR_OUTPUT_TOO_SMALL` error
+     * naming the needed size (default `false`).
+     */
+    outputFallback?: boolean,
+}
+
+/**
+ * Options for a streaming render.
+ */
+export interface StreamRenderOptions extends RenderOptions {
+    /**
+     * Bytes of encoder output queued before rendering waits for a
+     * paused consumer. Default is 65536.
+     */
+    highWaterMark?: number,
+}
+
+/**
+ * Controls delivery of a `renderToChunks` operation.
+ */
+export interface RenderChunksControl {
+    /** Resumes delivery after `onChunk` returned `false`. */
+    resume(): void;
+    /** Drops the rest of the output, the render fails with an error. */
+    cancel(): void;
+}
+
+/**
+ * Encoded page produced by `createRenderStream`.
+ */
+export interface RenderStream extends Readable {
+    /** Stops rendering, the rest of encoder output is dropped. */
+    cancel(): void;
+}
+
+/**
+ * Options for a `renderTiles` operation.
+ */
+export interface TileRenderOptions extends RenderOptions {
+    /** Resolution of every zoom level in pixels per inch. */
+    levels: number[],
+    /** Tile width and height in pixels. Default is 256. */
+    tileSize?: number,
+    /** Pixels every tile extends over its neighbours. Default is 0. */
+    overlap?: number,
+    /**
+     * Directory to write tiles to, as `<path>/<level>/<col>_<row>.<format>`.
+     * Tiles are returned as buffers if not set.
+     */
+    path?: string,
+}
+
+/**
+ * Options for a `renderPages` operation.
+ */
+export interface RenderPagesOptions extends RenderOptions {
+    /**
+     * Number of pages rendered at once. Defaults to the render pool size.
+     */
+    parallelism?: number,
+    /**
+     * Called for every page as soon as it is rendered. Results are not
+     * collected into an array if this callback is given.
+     */
+    onPage?: (err: Error | null, result?: PageRenderResult) => any,
+}
+
+/**
+ * Settings of the render thread pool.
+ */
+export interface RenderPoolOptions {
+    /**
+     * Number of render threads. Defaults to `POPPLER_RENDER_THREADS`
+     * environment variable or the number of CPUs.
+     */
+    threads?: number,
+    /**
+     * Maximum number of renders waiting for a thread. Renders over the
+     * limit fail with 'Render queue is full' error. 0 (default) means
+     * no limit.
+     */
+    maxQueueDepth?: number,
+}
+
+/**
+ * State of the render thread pool.
+ */
+export interface RenderPoolStats {
+    threads: number,
+    maxQueueDepth: number,
+    /** Renders running right now. */
+    active: number,
+    /** Renders waiting for a thread. */
+    queued: number,
+    /** Renders finished since the module was loaded. */
+    completed: number,
+    /** Renders rejected because the queue was full. */
+    rejected: number,
+    /** Renders taken off the queue by their abort signal. */
+    cancelled: number,
+}
+
+/**
+ * Changes settings of the thread pool asynchronous renders run on.
+ * It is separate from the libuv threadpool, so long renders don't
+ * block fs, dns and zlib operations.
+ */
+export function configureRenderPool(options: RenderPoolOptions): RenderPoolStats;
+
+/**
+ * Returns state of the render thread pool.
+ */
+export function getRenderPoolStats(): RenderPoolStats;
+
+/**
+ * Settings of the render cache.
+ */
+export interface RenderCacheOptions {
+    /**
+     * Memory budget of the cache in bytes. 0 (default) disables it.
+     */
+    maxBytes?: number,
+}
+
+/**
+ * State of the render cache.
+ */
+export interface RenderCacheStats {
+    /** Bytes held by cached renders. */
+    bytes: number,
+    maxBytes: number,
+    entries: number,
+    hits: number,
+    misses: number,
+    /** Renders dropped to stay within the budget. */
+    evictions: number,
+}
+
+/**
+ * Changes settings of the in-memory cache `renderToBuffer` results
+ * are looked up in. Results are cached per document instance, page,
+ * resolution, slice, format and encoder options. Adding or deleting
+ * annotations invalidates cached renders of the document.
+ */
+export function configureRenderCache(options: RenderCacheOptions): RenderCacheStats;
+
+/**
+ * Returns state of the render cache.
+ */
+export function getRenderCacheStats(): RenderCacheStats;
+
+/**
+ * Drops all cached renders.
+ */
+export function clearRenderCache(): void;
+
+/**
+ * Settings of the disk render cache.
+ */
+export interface DiskCacheOptions {
+    /**
+     * Directory rendered files are kept in. Created if missing.
+     * `null` disables the cache.
+     */
+    path?: string | null,
+    /**
+     * Size budget of the directory in bytes. Least recently used
+     * entries are deleted when it is exceeded. 0 (default) means
+     * no limit.
+     */
+    maxBytes?: number,
+}
+
+/**
+ * State of the disk render cache.
+ */
+export interface DiskCacheStats {
+    path: string | null,
+    /** Bytes held by cached files. */
+    bytes: number,
+    maxBytes: number,
+    hits: number,
+    misses: number,
+    /** Renders stored to the cache. */
+    writes: number,
+    /** Files deleted to stay within the budget. */
+    evictions: number,
+}
+
+/**
+ * Changes settings of the persistent cache `renderToBuffer` and
+ * `renderToFile` results are looked up in. Entries are keyed by
+ * SHA-256 of the document contents and the render options, so they
+ * survive restarts and are shared by processes using the same
+ * directory. Raw output and documents with added or deleted
+ * annotations are not cached.
+ */
+export function configureDiskCache(options: DiskCacheOptions): DiskCacheStats;
+
+/**
+ * Returns state of the disk render cache.
+ */
+export function getDiskCacheStats(): DiskCacheStats;
+
 /**
  * PDF document.
  */
+/**
+ * Options of a document.
+ */
+export interface DocumentOptions {
+    /**
+     * Parse a private copy of the data (default `true`). With `false` the
+     * document reads the given memory in place and keeps a reference to it
+     * for its lifetime, so the data must not be modified, and memory of
+     * a Buffer must not be transferred, while the document is open. Plain
+     * ArrayBuffers can be detached at any time and are always copied,
+     * `false` is rejected for them.
+     */
+    copy?: boolean,
+    /**
+     * Read a document file through a memory mapping (default `false`).
+     * Object lookups become memory reads, and all render instances and
+     * processes opening the file share the page cache. The file must not
+     * be truncated while the document is open.
+     */
+    mmap?: boolean,
+    /**
+     * Expected access pattern of a mapped file: `'random'` for viewers
+     * rendering a few pages, `'sequential'` for full scans (default
+     * `'normal'`).
+     */
+    access?: 'normal' | 'random' | 'sequential',
+}
+
+/**
+ * Pool of equally sized buffers for the `output` render option.
+ */
+export class BufferPool implements OutputBufferPool {
+    /**
+     * @param size size of pooled buffers in bytes
+     * @param max number of free buffers kept, default 16
+     */
+    constructor(size: number, max?: number);
+    /** Takes a free buffer or allocates a new one. */
+    acquire(): Buffer;
+    /** Returns a buffer, or result `data` sliced from it, to the pool. */
+    release(buffer: Buffer): void;
+}
+
 export class PopplerDocument {
     /** Is this document linearized? */
     isLinearized: boolean
@@ -172,17 +661,62 @@ export class PopplerDocument {
 
     /**
      * Constructor of a PDF document.
-     * @param fileName string | Buffer path to the document or a memory byffer containing pdf data.
+     * @param fileName string | Buffer | ArrayBuffer | SharedArrayBuffer path to the document or a memory byffer containing pdf data.
      * @param userPassword string? password required to open this document, if any.
      * @param ownerPassword string? password required to manipulate this document, if any.
+     * @param options DocumentOptions? options of opening the document.
      */
-    constructor(fileName: string | Buffer, userPassword?: string, ownerPassword?: string);
+    constructor(
+        fileName: string | Buffer | ArrayBuffer | SharedArrayBuffer,
+        userPassword?: string | null,
+        ownerPassword?: string | null,
+        options?: DocumentOptions,
+    );
 
     /**
      * This method will return a specified page if it exists in the document.
      * @param number number of desired page.
      */
     getPage(number: number): PopplerPage | null;
+
+    /**
+     * Renders a list of pages to buffers asyncronously in a single native batch.
+     *
+     * If a page fails to render and `onPage` is not given, the rest of the batch
+     * is stopped and `callback` gets an error with `page` field set.
+     * @param pages numbers of pages to render
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     * @param callback operation callback
+     */
+    renderPages(
+        pages: number[],
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
+        ppi: number,
+        options: RenderPagesOptions,
+        callback: (err: Error | null, result?: PageRenderResult[]) => any,
+    ): void;
+    renderPages(
+        pages: number[],
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
+        ppi: number,
+        callback: (err: Error | null, result?: PageRenderResult[]) => any,
+    ): void;
+
+    /**
+     * Renders a list of pages to buffers asyncronously. Returns `Promise`.
+     * @param pages numbers of pages to render
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     */
+    renderPagesAsync(
+        pages: number[],
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
+        ppi: number,
+        options?: RenderPagesOptions,
+    ): Promise<PageRenderResult[]>;
 }
 
 /**
@@ -263,9 +797,9 @@ export class PopplerPage {
      * @param options render options
      */
     renderToBuffer(
-        format: 'png' | 'jpeg' | 'tiff',
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
         ppi: number,
-        options?: RenderOptions,
+        options?: BufferRenderOptions,
     ): BufferRenderResult;
 
     /**
@@ -276,9 +810,9 @@ export class PopplerPage {
      * @param callback operation callback
      */
     renderToBuffer(
-        format: 'png' | 'jpeg' | 'tiff',
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
         ppi: number,
-        options?: RenderOptions,
+        options?: BufferRenderOptions,
         callback: (err: Error, result: BufferRenderResult) => any,
     ): void;
 
@@ -289,11 +823,116 @@ export class PopplerPage {
      * @param options render options
      */
     renderToBufferAsync(
-        format: 'png' | 'jpeg' | 'tiff',
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
         ppi: number,
-        options?: RenderOptions,
+        options?: BufferRenderOptions,
     ): Promise<BufferRenderResult>;
 
+    /**
+     * Renders page passing encoder output in chunks as it is produced.
+     * @param format output format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     * @param onChunk called with every chunk; returning `false` pauses
+     *                delivery until `resume()` is called
+     * @param callback called once all chunks are delivered
+     */
+    renderToChunks(
+        format: 'png' | 'jpeg',
+        ppi: number,
+        options: StreamRenderOptions,
+        onChunk: (chunk: Buffer) => boolean | void,
+        callback: (err: Error | null, result?: { type: 'stream', format: string }) => any,
+    ): RenderChunksControl;
+
+    /**
+     * Renders page to a readable stream of encoded data.
+     * @param format output format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     */
+    createRenderStream(
+        format: 'png' | 'jpeg',
+        ppi: number,
+        options?: StreamRenderOptions,
+    ): RenderStream;
+
+    /**
+     * Renders page as tiles of one or several zoom levels syncronously.
+     * Every level is rasterized once and then cut into tiles.
+     * @param format tile format
+     * @param options tiling and render options
+     */
+    renderTiles(
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
+        options: TileRenderOptions,
+    ): TileRenderResult[];
+
+    /**
+     * Renders page as tiles asyncronously using old-fashioned CPS API.
+     * @param format tile format
+     * @param options tiling and render options
+     * @param callback operation callback
+     */
+    renderTiles(
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
+        options: TileRenderOptions,
+        callback: (err: Error, result: TileRenderResult[]) => any,
+    ): void;
+
+    /**
+     * Renders page as tiles asyncronously. Returns `Promise`.
+     * @param format tile format
+     * @param options tiling and render options
+     */
+    renderTilesAsync(
+        format: 'png' | 'jpeg' | 'tiff' | 'raw',
+        options: TileRenderOptions,
+    ): Promise<TileRenderResult[]>;
+
+    /**
+     * Renders page to several buffers of different resolution syncronously.
+     * The page is rasterized once at the highest resolution, smaller
+     * variants are downscaled from that bitmap. Note that raw variants
+     * are not padded, their `stride` is `width` times pixel size.
+     * @param variants formats, resolutions and encoder options of outputs
+     * @param options `slice` shared by all variants, `signal` and budgets
+     */
+    renderVariants(
+        variants: RenderVariant[],
+        options?: { slice?: Slice, signal?: RenderAbortSignal, maxRenderMs?: number, maxOperations?: number },
+    ): VariantRenderResult[];
+
+    /**
+     * Renders page to several buffers asyncronously using old-fashioned CPS API.
+     * @param variants formats, resolutions and encoder options of outputs
+     * @param options `slice` shared by all variants, `signal` and budgets
+     * @param callback operation callback
+     */
+    renderVariants(
+        variants: RenderVariant[],
+        options: { slice?: Slice, signal?: RenderAbortSignal, maxRenderMs?: number, maxOperations?: number } | undefined,
+        callback: (err: Error, result: VariantRenderResult[]) => any,
+    ): void;
+
+    /**
+     * Renders page to several buffers asyncronously. Returns `Promise`.
+     * @param variants formats, resolutions and encoder options of outputs
+     * @param options `slice` shared by all variants, `signal` and budgets
+     */
+    renderVariantsAsync(
+        variants: RenderVariant[],
+        options?: { slice?: Slice, signal?: RenderAbortSignal, maxRenderMs?: number, maxOperations?: number },
+    ): Promise<VariantRenderResult[]>;
+
+    /**
+     * Estimates cost of rendering this page by scanning its content
+     * streams and resources, without rasterizing. Annotation appearances
+     * are not counted.
+     * @param PPI resolution of `outputPixels`, default 72
+     */
+    estimateCost(PPI?: number): PageCost;
+
     /**
      * This method tries to find `text` on this page.
      * @param text text to search
@@ -1,6 +1,8 @@
 (function () {
     'use strict';
     var Promise = require("bluebird");
+    var Readable = require("stream").Readable;
+    var util = require("util");
     try {
         try {
             module.exports = require('../build/Debug/poppler');
@@ -62,6 +64,24 @@
         };
     }
 
+    module.exports.PopplerDocument.prototype.renderPagesAsync = function () {
+        var self = this;
+        var args = Array.prototype.slice.call(arguments);
+        return new Promise(function (resolve, reject) {
+            if (typeof args[args.length - 1] === 'function') {
+                args.pop();
+            }
+            args.push(function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+            self.renderPages.apply(self, args);
+        });
+    };
+
     module.exports.PopplerPage.prototype.renderToFileAsync = function () {
         var self = this;
         var args = Array.prototype.slice.call(arguments);
@@ -97,4 +117,124 @@
             self.renderToBuffer.apply(self, args);
         });
     };
+
+    module.exports.PopplerPage.prototype.renderTilesAsync = function () {
+        var self = this;
+        var args = Array.prototype.slice.call(arguments);
+        return new Promise(function (resolve, reject) {
+            if (typeof args[args.length - 1] === 'function') {
+                args.pop();
+            }
+            args.push(function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+            self.renderTiles.apply(self, args);
+        });
+    };
+
+    module.exports.PopplerPage.prototype.renderVariantsAsync = function () {
+        var self = this;
+        var args = Array.prototype.slice.call(arguments);
+        return new Promise(function (resolve, reject) {
+            if (typeof args[args.length - 1] === 'function') {
+                args.pop();
+            }
+            args.push(function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+            self.renderVariants.apply(self, args);
+        });
+    };
+
+    function RenderStream(page, method, PPI, options) {
+        Readable.call(this, options && options.highWaterMark ? { highWaterMark: options.highWaterMark } : {});
+        var self = this;
+        this._control = page.renderToChunks(method, PPI, options || {}, function (chunk) {
+            return self.push(chunk);
+        }, function (err) {
+            if (self._cancelled) {
+                return;
+            }
+            if (err) {
+                // emitted on next tick, so the caller can listen to argument errors
+                self.destroy(err);
+            } else {
+                self.push(null);
+            }
+        });
+    }
+    util.inherits(RenderStream, Readable);
+
+    RenderStream.prototype._read = function () {
+        // there is no render when arguments were rejected
+        if (this._control) {
+            this._control.resume();
+        }
+    };
+
+    RenderStream.prototype._destroy = function (err, cb) {
+        this.cancel();
+        cb(err);
+    };
+
+    /**
+     * Stops rendering, the rest of encoder output is dropped.
+     */
+    RenderStream.prototype.cancel = function () {
+        this._cancelled = true;
+        if (this._control) {
+            this._control.cancel();
+        }
+    };
+
+    module.exports.PopplerPage.prototype.createRenderStream = function (method, PPI, options) {
+        return new RenderStream(this, method, PPI, options);
+    };
+
+    /**
+     * Pool of equally sized buffers for the `output` option of
+     * renderToBuffer.
+     */
+    function BufferPool(size, max) {
+        this.size = size;
+        this.max = max === undefined ? 16 : max;
+        this._free = [];
+        // memory allocated by the pool, and the part of it which is free
+        this._owned = new WeakSet();
+        this._freeSet = new Set();
+    }
+
+    BufferPool.prototype.acquire = function () {
+        if (this._free.length > 0) {
+            var buffer = this._free.pop();
+            this._freeSet.delete(buffer.buffer);
+            return buffer;
+        }
+        buffer = Buffer.allocUnsafeSlow(this.size);
+        this._owned.add(buffer.buffer);
+        return buffer;
+    };
+
+    /**
+     * Returns a pool buffer or render result data sliced from it.
+     * Buffers of other origin and ones already released are ignored.
+     */
+    BufferPool.prototype.release = function (buffer) {
+        var memory = buffer.buffer;
+        if (!this._owned.has(memory) || this._freeSet.has(memory) || this._free.length >= this.max) {
+            return;
+        }
+        this._freeSet.add(memory);
+        this._free.push(Buffer.from(memory, 0, this.size));
+    };
+
+    module.exports.BufferPool = BufferPool;
 })();
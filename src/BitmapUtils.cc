@@ -0,0 +1,264 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "BitmapUtils.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+void xbgrToBGRA(unsigned char *row, size_t width)
+{
+    size_t x = 0;
+#if defined(__SSE2__)
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i *p = (__m128i *)(row + x * 4);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), alpha));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t px = vld4q_u8(row + x * 4);
+        px.val[3] = vdupq_n_u8(255);
+        vst4q_u8(row + x * 4, px);
+    }
+#endif
+    for (; x < width; x++)
+    {
+        row[x * 4 + 3] = 255;
+    }
+}
+
+void xbgrToRGBA(unsigned char *row, size_t width)
+{
+    size_t x = 0;
+#if defined(__SSE2__)
+    // pixels are loaded as little endian words: X << 24 | R << 16 | G << 8 | B
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    const __m128i green = _mm_set1_epi32(0x0000FF00);
+    const __m128i low = _mm_set1_epi32(0x000000FF);
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i *p = (__m128i *)(row + x * 4);
+        __m128i px = _mm_loadu_si128(p);
+        __m128i out = _mm_or_si128(_mm_and_si128(px, green), alpha);
+        out = _mm_or_si128(out, _mm_and_si128(_mm_srli_epi32(px, 16), low));
+        out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(px, low), 16));
+        _mm_storeu_si128(p, out);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t px = vld4q_u8(row + x * 4);
+        uint8x16_t b = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = b;
+        px.val[3] = vdupq_n_u8(255);
+        vst4q_u8(row + x * 4, px);
+    }
+#endif
+    for (; x < width; x++)
+    {
+        unsigned char *p = row + x * 4;
+        unsigned char b = p[0];
+        p[0] = p[2];
+        p[2] = b;
+        p[3] = 255;
+    }
+}
+
+void rgbToRGBA(const unsigned char *src, unsigned char *dst, size_t width)
+{
+    for (size_t x = 0; x < width; x++, src += 3, dst += 4)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 255;
+    }
+}
+
+void rgbToBGRA(const unsigned char *src, unsigned char *dst, size_t width)
+{
+    for (size_t x = 0; x < width; x++, src += 3, dst += 4)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 255;
+    }
+}
+
+void rgbToGray(const unsigned char *src, unsigned char *dst, size_t width)
+{
+    // same weights as splash uses for mono modes
+    for (size_t x = 0; x < width; x++, src += 3)
+    {
+        dst[x] = (unsigned char)((src[0] * 77 + src[1] * 150 + src[2] * 29 + 128) >> 8);
+    }
+}
+
+// weights are fixed point with 15 fractional bits, so one fits in 16 bits
+#define AREA_SHIFT 15
+#define AREA_ONE (1 << AREA_SHIFT)
+
+struct AreaSpan
+{
+    size_t first;
+    std::vector<unsigned short> weights;
+};
+
+/**
+     * Splits every destination pixel into weights of source pixels it covers
+     */
+static void areaSpans(size_t srcLen, size_t dstLen, std::vector<AreaSpan> &spans)
+{
+    double scale = (double)srcLen / dstLen;
+    spans.resize(dstLen);
+    for (size_t i = 0; i < dstLen; i++)
+    {
+        double start = i * scale;
+        double end = std::min((i + 1) * scale, (double)srcLen);
+        size_t first = (size_t)start;
+        size_t last = std::min((size_t)ceil(end), srcLen);
+        AreaSpan &span = spans[i];
+        span.first = first;
+        span.weights.clear();
+        int total = 0;
+        size_t largest = 0;
+        for (size_t j = first; j < last; j++)
+        {
+            double cover = std::min((double)j + 1, end) - std::max((double)j, start);
+            int w = (int)(cover / scale * AREA_ONE + 0.5);
+            span.weights.push_back(w);
+            total += w;
+            if (w > span.weights[largest])
+                largest = span.weights.size() - 1;
+        }
+        // make weights sum up to exactly one
+        span.weights[largest] += AREA_ONE - total;
+    }
+}
+
+/**
+     * acc[i] += row[i] * weight
+     */
+static void accumulateRow(const unsigned char *row, unsigned int *acc, size_t len, unsigned short weight)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16((short)weight);
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i halves[2] = {_mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero)};
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i lo = _mm_mullo_epi16(halves[h], w);
+            __m128i hi = _mm_mulhi_epu16(halves[h], w);
+            __m128i *a = (__m128i *)(acc + i + h * 8);
+            _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, hi)));
+            _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, hi)));
+        }
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 8 <= len; i += 8)
+    {
+        uint16x8_t px = vmovl_u8(vld1_u8(row + i));
+        vst1q_u32(acc + i, vmlal_n_u16(vld1q_u32(acc + i), vget_low_u16(px), weight));
+        vst1q_u32(acc + i + 4, vmlal_n_u16(vld1q_u32(acc + i + 4), vget_high_u16(px), weight));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        acc[i] += row[i] * (unsigned int)weight;
+    }
+}
+
+/**
+     * row[i] = round(acc[i] / AREA_ONE)
+     */
+static void normalizeRow(const unsigned int *acc, unsigned char *row, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i half = _mm_set1_epi32(AREA_ONE / 2);
+    for (; i + 8 <= len; i += 8)
+    {
+        __m128i a = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + i)), half), AREA_SHIFT);
+        __m128i b = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + i + 4)), half), AREA_SHIFT);
+        // values are at most 255, so signed saturation is exact
+        __m128i w = _mm_packs_epi32(a, b);
+        _mm_storel_epi64((__m128i *)(row + i), _mm_packus_epi16(w, w));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 8 <= len; i += 8)
+    {
+        uint16x4_t a = vrshrn_n_u32(vld1q_u32(acc + i), AREA_SHIFT);
+        uint16x4_t b = vrshrn_n_u32(vld1q_u32(acc + i + 4), AREA_SHIFT);
+        vst1_u8(row + i, vmovn_u16(vcombine_u16(a, b)));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        row[i] = (unsigned char)((acc[i] + AREA_ONE / 2) >> AREA_SHIFT);
+    }
+}
+
+bool areaDownscale(const unsigned char *src, size_t srcWidth, size_t srcHeight, size_t srcStride,
+                   unsigned char *dst, size_t dstWidth, size_t dstHeight, size_t dstStride,
+                   int bpp)
+{
+    std::vector<AreaSpan> rows, cols;
+    areaSpans(srcHeight, dstHeight, rows);
+    areaSpans(srcWidth, dstWidth, cols);
+
+    size_t len = srcWidth * bpp;
+    unsigned int *acc = (unsigned int *)malloc(len * sizeof(unsigned int));
+    unsigned char *line = (unsigned char *)malloc(len);
+    if (acc == NULL || line == NULL)
+    {
+        free(acc);
+        free(line);
+        return false;
+    }
+
+    for (size_t y = 0; y < dstHeight; y++)
+    {
+        const AreaSpan &rs = rows[y];
+        memset(acc, 0, len * sizeof(unsigned int));
+        for (size_t k = 0; k < rs.weights.size(); k++)
+        {
+            accumulateRow(src + (rs.first + k) * srcStride, acc, len, rs.weights[k]);
+        }
+        normalizeRow(acc, line, len);
+
+        unsigned char *out = dst + y * dstStride;
+        for (size_t x = 0; x < dstWidth; x++)
+        {
+            const AreaSpan &cs = cols[x];
+            for (int c = 0; c < bpp; c++)
+            {
+                unsigned int sum = AREA_ONE / 2;
+                const unsigned char *p = line + cs.first * bpp + c;
+                for (size_t k = 0; k < cs.weights.size(); k++, p += bpp)
+                {
+                    sum += *p * (unsigned int)cs.weights[k];
+                }
+                out[x * bpp + c] = (unsigned char)(sum >> AREA_SHIFT);
+            }
+        }
+    }
+
+    free(acc);
+    free(line);
+    return true;
+}
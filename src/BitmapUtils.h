@@ -0,0 +1,34 @@
+#ifndef __BITMAP_UTILS
+#define __BITMAP_UTILS
+#include <stddef.h>
+
+/**
+ * Pixel conversions over SplashBitmap rows.
+ *
+ * Rows in splashModeXBGR8 are stored as B, G, R, X bytes. These
+ * helpers rewrite them in place, using SSE2 or NEON when available.
+ */
+
+// B, G, R, X -> B, G, R, 255
+void xbgrToBGRA(unsigned char *row, size_t width);
+// B, G, R, X -> R, G, B, 255
+void xbgrToRGBA(unsigned char *row, size_t width);
+
+// R, G, B -> R, G, B, 255 / B, G, R, 255 / luminance
+void rgbToRGBA(const unsigned char *src, unsigned char *dst, size_t width);
+void rgbToBGRA(const unsigned char *src, unsigned char *dst, size_t width);
+void rgbToGray(const unsigned char *src, unsigned char *dst, size_t width);
+
+/**
+ * Shrinks a bitmap with area averaging, every destination pixel is
+ * the mean of the source pixels it covers. Rows are averaged first,
+ * channel agnostic and vectorized, then columns.
+ *
+ * \param bpp bytes per pixel of both bitmaps
+ * \return false if scratch memory could not be allocated
+ */
+bool areaDownscale(const unsigned char *src, size_t srcWidth, size_t srcHeight, size_t srcStride,
+                   unsigned char *dst, size_t dstWidth, size_t dstHeight, size_t dstStride,
+                   int bpp);
+
+#endif
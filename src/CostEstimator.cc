@@ -0,0 +1,352 @@
+#include <string.h>
+#include <string>
+#include <poppler/Lexer.h>
+#include <poppler/Stream.h>
+
+#include "CostEstimator.h"
+
+// deeper form nesting is not drawn by Gfx either
+static const int MAX_FORM_DEPTH = 32;
+
+/*
+ * Object API helpers. Objects returned by these must be released with
+ * freeObj() for poppler 0.57 and older.
+ */
+static Object dictLookup(Dict *dict, const char *key)
+{
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object obj;
+    dict->lookup(key, &obj);
+    return obj;
+#else
+    return dict->lookup(key);
+#endif
+}
+
+static Object dictLookupNF(Dict *dict, const char *key)
+{
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object obj;
+    dict->lookupNF(key, &obj);
+    return obj;
+#else
+    return dict->lookupNF(key).copy();
+#endif
+}
+
+static Object dictValueNF(Dict *dict, int i)
+{
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object obj;
+    dict->getValNF(i, &obj);
+    return obj;
+#else
+    return dict->getValNF(i).copy();
+#endif
+}
+
+static void freeObj(Object &obj)
+{
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    obj.free();
+#endif
+}
+
+static Object nextToken(Lexer *lexer)
+{
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object obj;
+    lexer->getObj(&obj);
+    return obj;
+#else
+    return lexer->getObj();
+#endif
+}
+
+/**
+     * Number value of the dict entry, 0 if missing
+     */
+static double dictNumber(Dict *dict, const char *key, const char *altKey = NULL)
+{
+    Object obj = dictLookup(dict, key);
+    if (!obj.isNum() && altKey != NULL)
+    {
+        freeObj(obj);
+        obj = dictLookup(dict, altKey);
+    }
+    double value = obj.isNum() ? obj.getNum() : 0;
+    freeObj(obj);
+    return value;
+}
+
+static bool isSpaceChar(int c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\0';
+}
+
+/**
+     * Skips inline image data up to and including the EI operator
+     */
+static void skipInlineImage(Lexer *lexer)
+{
+    Stream *str = lexer->getStream();
+    if (str == NULL)
+        return;
+    int prev = ' ';
+    int c = str->getChar();
+    while (c != EOF)
+    {
+        if (isSpaceChar(prev) && c == 'E')
+        {
+            int c2 = str->getChar();
+            if (c2 == 'I')
+            {
+                int c3 = str->lookChar();
+                if (c3 == EOF || isSpaceChar(c3))
+                    return;
+            }
+            prev = c;
+            c = c2;
+            continue;
+        }
+        prev = c;
+        c = str->getChar();
+    }
+}
+
+void PageCost::add(const PageCost &other)
+{
+    operators += other.operators;
+    pathOperators += other.pathOperators;
+    textOperators += other.textOperators;
+    shadings += other.shadings;
+    images += other.images;
+    imagePixels += other.imagePixels;
+    transparencyGroups += other.transparencyGroups;
+}
+
+CostEstimator::CostEstimator(XRef *xref)
+    : xref(xref), directFonts(0)
+{
+}
+
+PageCost CostEstimator::estimate(Page *page)
+{
+    PageCost cost;
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object contents;
+    page->getContents(&contents);
+#else
+    Object contents = page->getContents();
+#endif
+    Dict *resources = page->getResourceDict();
+    if (resources != NULL)
+        addFonts(resources);
+    if (contents.isStream() || contents.isArray())
+    {
+        scan(&contents, resources, cost, 0);
+    }
+    freeObj(contents);
+    cost.fonts = fonts.size() + directFonts;
+    return cost;
+}
+
+void CostEstimator::scan(Object *content, Dict *resources, PageCost &cost, int depth)
+{
+    Lexer *lexer = new Lexer(xref, content);
+    std::string lastName;
+    // inline image dictionary state
+    bool inImageDict = false;
+    std::string imageKey;
+    double imageWidth = 0, imageHeight = 0;
+
+    for (;;)
+    {
+        Object token = nextToken(lexer);
+        if (token.isEOF())
+        {
+            freeObj(token);
+            break;
+        }
+        if (token.isName())
+        {
+            lastName = token.getName();
+            if (inImageDict)
+                imageKey = lastName;
+        }
+        else if (token.isNum() && inImageDict)
+        {
+            if (imageKey == "W" || imageKey == "Width")
+                imageWidth = token.getNum();
+            else if (imageKey == "H" || imageKey == "Height")
+                imageHeight = token.getNum();
+        }
+        else if (token.isCmd())
+        {
+            const char *cmd = token.getCmd();
+            if (strcmp(cmd, "[") == 0 || strcmp(cmd, "]") == 0 ||
+                strcmp(cmd, "<<") == 0 || strcmp(cmd, ">>") == 0 ||
+                strcmp(cmd, "{") == 0 || strcmp(cmd, "}") == 0)
+            {
+                // array and dict delimiters of operands
+                freeObj(token);
+                continue;
+            }
+            cost.operators++;
+            if (strcmp(cmd, "m") == 0 || strcmp(cmd, "l") == 0 || strcmp(cmd, "c") == 0 ||
+                strcmp(cmd, "v") == 0 || strcmp(cmd, "y") == 0 || strcmp(cmd, "h") == 0 ||
+                strcmp(cmd, "re") == 0)
+            {
+                cost.pathOperators++;
+            }
+            else if (strcmp(cmd, "Tj") == 0 || strcmp(cmd, "TJ") == 0 ||
+                     strcmp(cmd, "'") == 0 || strcmp(cmd, "\"") == 0)
+            {
+                cost.textOperators++;
+            }
+            else if (strcmp(cmd, "sh") == 0)
+            {
+                cost.shadings++;
+            }
+            else if (strcmp(cmd, "Do") == 0 && resources != NULL)
+            {
+                drawXObject(resources, lastName.c_str(), cost, depth);
+            }
+            else if (strcmp(cmd, "gs") == 0 && resources != NULL)
+            {
+                setExtGState(resources, lastName.c_str(), cost);
+            }
+            else if (strcmp(cmd, "BI") == 0)
+            {
+                inImageDict = true;
+                imageKey.clear();
+                imageWidth = imageHeight = 0;
+            }
+            else if (strcmp(cmd, "ID") == 0)
+            {
+                inImageDict = false;
+                cost.images++;
+                cost.imagePixels += imageWidth * imageHeight;
+                skipInlineImage(lexer);
+            }
+        }
+        freeObj(token);
+    }
+    delete lexer;
+}
+
+/**
+     * Counts drawing of a named XObject
+     */
+void CostEstimator::drawXObject(Dict *resources, const char *name, PageCost &cost, int depth)
+{
+    Object xobjects = dictLookup(resources, "XObject");
+    if (!xobjects.isDict())
+    {
+        freeObj(xobjects);
+        return;
+    }
+    Object ref = dictLookupNF(xobjects.getDict(), name);
+    Object xobj = dictLookup(xobjects.getDict(), name);
+    if (xobj.isStream())
+    {
+        Dict *dict = xobj.getStream()->getDict();
+        Object subtype = dictLookup(dict, "Subtype");
+        if (subtype.isName("Image"))
+        {
+            cost.images++;
+            cost.imagePixels += dictNumber(dict, "Width") * dictNumber(dict, "Height");
+            // soft masks are decoded along with the image
+            Object smask = dictLookup(dict, "SMask");
+            if (smask.isStream())
+            {
+                Dict *maskDict = smask.getStream()->getDict();
+                cost.imagePixels += dictNumber(maskDict, "Width") * dictNumber(maskDict, "Height");
+            }
+            freeObj(smask);
+        }
+        else if (subtype.isName("Form") && depth < MAX_FORM_DEPTH)
+        {
+            int num = ref.isRef() ? ref.getRefNum() : -1;
+            std::map<int, PageCost>::iterator cached = forms.find(num);
+            if (num >= 0 && cached != forms.end())
+            {
+                cost.add(cached->second);
+            }
+            else if (num < 0 || scanning.find(num) == scanning.end())
+            {
+                PageCost formCost;
+                Object group = dictLookup(dict, "Group");
+                if (group.isDict())
+                {
+                    Object s = dictLookup(group.getDict(), "S");
+                    if (s.isName("Transparency"))
+                        formCost.transparencyGroups++;
+                    freeObj(s);
+                }
+                freeObj(group);
+
+                Object formResources = dictLookup(dict, "Resources");
+                if (formResources.isDict())
+                    addFonts(formResources.getDict());
+                if (num >= 0)
+                    scanning.insert(num);
+                scan(&xobj, formResources.isDict() ? formResources.getDict() : resources, formCost, depth + 1);
+                if (num >= 0)
+                {
+                    scanning.erase(num);
+                    forms[num] = formCost;
+                }
+                freeObj(formResources);
+                cost.add(formCost);
+            }
+        }
+        freeObj(subtype);
+    }
+    freeObj(xobj);
+    freeObj(ref);
+    freeObj(xobjects);
+}
+
+/**
+     * Counts soft masks set by a named graphics state
+     */
+void CostEstimator::setExtGState(Dict *resources, const char *name, PageCost &cost)
+{
+    Object states = dictLookup(resources, "ExtGState");
+    if (states.isDict())
+    {
+        Object state = dictLookup(states.getDict(), name);
+        if (state.isDict())
+        {
+            Object smask = dictLookup(state.getDict(), "SMask");
+            if (smask.isDict())
+                cost.transparencyGroups++;
+            freeObj(smask);
+        }
+        freeObj(state);
+    }
+    freeObj(states);
+}
+
+/**
+     * Collects distinct fonts of a resource dict
+     */
+void CostEstimator::addFonts(Dict *resources)
+{
+    Object fontDict = dictLookup(resources, "Font");
+    if (fontDict.isDict())
+    {
+        Dict *dict = fontDict.getDict();
+        for (int i = 0; i < dict->getLength(); i++)
+        {
+            Object font = dictValueNF(dict, i);
+            if (font.isRef())
+                fonts.insert(font.getRefNum());
+            else
+                directFonts++;
+            freeObj(font);
+        }
+    }
+    freeObj(fontDict);
+}
@@ -0,0 +1,61 @@
+#ifndef __COST_ESTIMATOR
+#define __COST_ESTIMATOR
+#include <map>
+#include <set>
+#include <poppler/poppler-config.h>
+#include <cpp/poppler-version.h>
+#include <poppler/Object.h>
+#include <poppler/XRef.h>
+#include <poppler/Page.h>
+
+/**
+ * Drawing work found in page content, counted per drawing, i.e. a form
+ * XObject drawn twice counts twice.
+ */
+struct PageCost
+{
+    unsigned long operators;
+    unsigned long pathOperators;
+    unsigned long textOperators;
+    unsigned long shadings;
+    unsigned long images;
+    double imagePixels;
+    unsigned long transparencyGroups;
+    unsigned long fonts;
+
+    PageCost()
+        : operators(0), pathOperators(0), textOperators(0), shadings(0),
+          images(0), imagePixels(0), transparencyGroups(0), fonts(0)
+    {
+    }
+    void add(const PageCost &other);
+};
+
+/**
+ * Estimates cost of rendering a page by tokenizing its content streams
+ * with poppler's Lexer, without building graphics state or decoding
+ * images.
+ *
+ * Form XObjects are scanned once and their cost is added for every
+ * drawing, so deeply nested forms don't blow up the scan.
+ */
+class CostEstimator
+{
+  public:
+    CostEstimator(XRef *xref);
+
+    PageCost estimate(Page *page);
+
+  private:
+    void scan(Object *content, Dict *resources, PageCost &cost, int depth);
+    void drawXObject(Dict *resources, const char *name, PageCost &cost, int depth);
+    void setExtGState(Dict *resources, const char *name, PageCost &cost);
+    void addFonts(Dict *resources);
+
+    XRef *xref;
+    std::map<int, PageCost> forms;
+    std::set<int> scanning;
+    std::set<int> fonts;
+    unsigned long directFonts;
+};
+#endif
@@ -0,0 +1,475 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __linux
+#include <sys/sendfile.h>
+#endif
+#include <algorithm>
+#include <vector>
+#include <cpp/poppler-version.h>
+
+#include "DiskCache.h"
+#include "Sha256.h"
+
+using namespace v8;
+using Nan::To;
+
+namespace node
+{
+
+struct DiskCacheFile
+{
+    std::string path;
+    time_t mtime;
+    unsigned long long size;
+
+    bool operator<(const DiskCacheFile &other) const
+    {
+        return mtime < other.mtime;
+    }
+};
+
+/**
+     * Lists cache entries, skipping unfinished temporary files
+     */
+static void listEntries(const std::string &dir, std::vector<DiskCacheFile> &files)
+{
+    DIR *root = opendir(dir.c_str());
+    if (root == NULL)
+        return;
+    struct dirent *sub;
+    while ((sub = readdir(root)) != NULL)
+    {
+        if (strlen(sub->d_name) != 2)
+            continue;
+        std::string subdir = dir + "/" + sub->d_name;
+        DIR *d = opendir(subdir.c_str());
+        if (d == NULL)
+            continue;
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL)
+        {
+            if (ent->d_name[0] == '.' || strchr(ent->d_name, '.') != NULL)
+                continue;
+            DiskCacheFile file;
+            file.path = subdir + "/" + ent->d_name;
+            struct stat st;
+            if (stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+            file.mtime = st.st_mtime;
+            file.size = st.st_size;
+            files.push_back(file);
+        }
+        closedir(d);
+    }
+    closedir(root);
+}
+
+static bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+/**
+     * Copies `length` bytes between file descriptors, in kernel if possible
+     */
+static bool copyFd(int src, int dst, size_t length)
+{
+#ifdef __linux
+    off_t offset = 0;
+    while ((size_t)offset < length)
+    {
+        ssize_t n = sendfile(dst, src, &offset, length - offset);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+    }
+    if ((size_t)offset == length)
+        return true;
+    if (offset > 0)
+        return false;
+    // sendfile is not supported for these descriptors
+#endif
+    char buf[65536];
+    size_t copied = 0;
+    while (copied < length)
+    {
+        ssize_t n = read(src, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        if (!writeAll(dst, buf, n))
+            return false;
+        copied += n;
+    }
+    return true;
+}
+
+DiskCache *DiskCache::get()
+{
+    // created on the main thread by Init
+    static DiskCache *cache = new DiskCache();
+    return cache;
+}
+
+DiskCache::DiskCache()
+    : bytes(0), maxBytes(0), hits(0), misses(0), writes(0), evictions(0)
+{
+    uv_mutex_init(&mutex);
+}
+
+bool DiskCache::isEnabled()
+{
+    uv_mutex_lock(&mutex);
+    bool enabled = !dir.empty();
+    uv_mutex_unlock(&mutex);
+    return enabled;
+}
+
+// bump when the meaning of render parameters or entry layout changes
+static const int DISK_CACHE_SCHEMA = 1;
+
+/**
+     * Path of the entry for a document and render parameters,
+     * empty if the cache is disabled. Entries are also keyed by poppler
+     * version, since other versions may render differently.
+     */
+std::string DiskCache::entryPath(const std::string &docHash, const std::string &params)
+{
+    uv_mutex_lock(&mutex);
+    std::string root = dir;
+    uv_mutex_unlock(&mutex);
+    if (root.empty() || docHash.empty())
+        return std::string();
+
+    char salt[64];
+    snprintf(salt, sizeof(salt), "%d:%d.%d.%d\n", DISK_CACHE_SCHEMA,
+             POPPLER_VERSION_MAJOR, POPPLER_VERSION_MINOR, POPPLER_VERSION_MICRO);
+    Sha256 sha;
+    sha.update(salt, strlen(salt));
+    sha.update(docHash.data(), docHash.size());
+    sha.update("\n", 1);
+    sha.update(params.data(), params.size());
+    std::string hash = sha.hexDigest();
+    return root + "/" + hash.substr(0, 2) + "/" + hash;
+}
+
+/**
+     * Writes the entry to `dst`. Returns false if there is no such entry.
+     */
+bool DiskCache::copyTo(const std::string &path, FILE *dst)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        uv_mutex_lock(&mutex);
+        misses++;
+        uv_mutex_unlock(&mutex);
+        return false;
+    }
+
+    bool ok;
+    size_t length = st.st_size;
+    int dstFd = fileno(dst);
+    if (dstFd >= 0)
+    {
+        // hand the file over in kernel
+        fflush(dst);
+        ok = copyFd(fd, dstFd, length);
+        if (!ok)
+        {
+            // leave an empty file for the regular render
+            if (ftruncate(dstFd, 0) == 0)
+                lseek(dstFd, 0, SEEK_SET);
+            fseek(dst, 0, SEEK_SET);
+        }
+    }
+    else
+    {
+        char *data = (char *)malloc(length > 0 ? length : 1);
+        size_t got = 0;
+        while (data != NULL && got < length)
+        {
+            ssize_t n = read(fd, data + got, length - got);
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                break;
+            }
+            got += n;
+        }
+        ok = data != NULL && got == length && fwrite(data, 1, length, dst) == length;
+        free(data);
+    }
+    close(fd);
+
+    if (ok)
+    {
+        // refresh the entry for eviction order
+        utimes(path.c_str(), NULL);
+    }
+    uv_mutex_lock(&mutex);
+    if (ok)
+        hits++;
+    else
+        misses++;
+    uv_mutex_unlock(&mutex);
+    return ok;
+}
+
+bool DiskCache::openTemp(const std::string &path, std::string &tmpPath, int *fd)
+{
+    static unsigned long counter = 0;
+    std::string subdir = path.substr(0, path.rfind('/'));
+    if (mkdir(subdir.c_str(), 0777) != 0 && errno != EEXIST)
+        return false;
+
+    char suffix[64];
+    uv_mutex_lock(&mutex);
+    snprintf(suffix, sizeof(suffix), ".tmp.%d.%lu", (int)getpid(), counter++);
+    uv_mutex_unlock(&mutex);
+    tmpPath = path + suffix;
+    *fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    return *fd >= 0;
+}
+
+/**
+     * Moves a complete temporary file into place
+     */
+void DiskCache::commit(const std::string &tmpPath, const std::string &path, size_t length)
+{
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmpPath.c_str());
+        return;
+    }
+    uv_mutex_lock(&mutex);
+    writes++;
+    bytes += length;
+    bool over = maxBytes > 0 && bytes > maxBytes;
+    uv_mutex_unlock(&mutex);
+    if (over)
+    {
+        evict();
+    }
+}
+
+void DiskCache::store(const std::string &path, const char *data, size_t length)
+{
+    std::string tmpPath;
+    int fd;
+    if (!openTemp(path, tmpPath, &fd))
+        return;
+    bool ok = writeAll(fd, data, length);
+    ok = close(fd) == 0 && ok;
+    if (ok)
+        commit(tmpPath, path, length);
+    else
+        unlink(tmpPath.c_str());
+}
+
+void DiskCache::storeFile(const std::string &path, const char *srcPath)
+{
+    int src = open(srcPath, O_RDONLY);
+    struct stat st;
+    if (src < 0 || fstat(src, &st) != 0)
+    {
+        if (src >= 0)
+            close(src);
+        return;
+    }
+    std::string tmpPath;
+    int fd;
+    if (!openTemp(path, tmpPath, &fd))
+    {
+        close(src);
+        return;
+    }
+    bool ok = copyFd(src, fd, st.st_size);
+    ok = close(fd) == 0 && ok;
+    close(src);
+    if (ok)
+        commit(tmpPath, path, st.st_size);
+    else
+        unlink(tmpPath.c_str());
+}
+
+/**
+     * Rescans the directory, which may be shared with other processes,
+     * and removes oldest entries until it takes 90% of the limit
+     */
+void DiskCache::evict()
+{
+    uv_mutex_lock(&mutex);
+    std::string root = dir;
+    unsigned long long limit = maxBytes;
+    uv_mutex_unlock(&mutex);
+    if (root.empty())
+        return;
+
+    std::vector<DiskCacheFile> files;
+    listEntries(root, files);
+    unsigned long long total = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        total += files[i].size;
+    }
+    unsigned long removed = 0;
+    if (limit > 0 && total > limit)
+    {
+        std::sort(files.begin(), files.end());
+        unsigned long long target = limit / 10 * 9;
+        for (size_t i = 0; i < files.size() && total > target; i++)
+        {
+            if (unlink(files[i].path.c_str()) == 0)
+            {
+                total -= files[i].size;
+                removed++;
+            }
+        }
+    }
+
+    uv_mutex_lock(&mutex);
+    bytes = total;
+    evictions += removed;
+    uv_mutex_unlock(&mutex);
+}
+
+/**
+     * Changes disk cache settings
+     *
+     * Javascript function
+     *
+     * \param options Object with optional fields:
+     *   path: String - cache directory, created if missing. Empty string
+     *              or null disables the cache.
+     *   maxBytes: Number - size limit of the directory, 0 for no limit
+     *
+     * \return Object \see DiskCache::getStats
+     */
+NAN_METHOD(DiskCache::configure)
+{
+    Nan::HandleScope scope;
+    DiskCache *cache = get();
+
+    if (info.Length() < 1 || !info[0]->IsObject())
+    {
+        return Nan::ThrowError("Arguments: (options: {path?: String, maxBytes?: Number})");
+    }
+
+    Local<v8::Object> options = To<v8::Object>(info[0]).ToLocalChecked();
+    Local<String> pk = Nan::New("path").ToLocalChecked();
+    Local<String> mk = Nan::New("maxBytes").ToLocalChecked();
+    // all options are validated before any is applied
+    bool hasMaxBytes = options->Has(mk);
+    unsigned long long maxBytes = 0;
+    if (hasMaxBytes)
+    {
+        Local<Value> mv = options->Get(mk);
+        if (!mv->IsNumber() || To<double>(mv).FromJust() < 0)
+        {
+            return Nan::ThrowError("'maxBytes' option value must be a non-negative number");
+        }
+        maxBytes = (unsigned long long)To<double>(mv).FromJust();
+    }
+    bool hasPath = options->Has(pk);
+    std::string path;
+    if (hasPath)
+    {
+        Local<Value> pv = options->Get(pk);
+        if (pv->IsString())
+        {
+            Nan::Utf8String p(pv);
+            path = *p;
+            while (path.size() > 1 && path[path.size() - 1] == '/')
+            {
+                path.erase(path.size() - 1);
+            }
+        }
+        else if (!pv->IsNull() && !pv->IsUndefined())
+        {
+            return Nan::ThrowError("'path' option must be an instance of string");
+        }
+        if (!path.empty() && mkdir(path.c_str(), 0777) != 0 && errno != EEXIST)
+        {
+            return Nan::ThrowError("Could not create disk cache directory");
+        }
+    }
+    uv_mutex_lock(&cache->mutex);
+    if (hasMaxBytes)
+    {
+        cache->maxBytes = maxBytes;
+    }
+    if (hasPath)
+    {
+        cache->dir = path;
+        cache->bytes = 0;
+    }
+    uv_mutex_unlock(&cache->mutex);
+    // count what is already there and apply the limit
+    cache->evict();
+
+    getStats(info);
+}
+
+/**
+     * \return Object Disk cache state: path, bytes, maxBytes and hits,
+     *                misses, writes and evictions totals
+     */
+NAN_METHOD(DiskCache::getStats)
+{
+    Nan::HandleScope scope;
+    DiskCache *cache = get();
+    Local<v8::Object> stats = Nan::New<v8::Object>();
+
+    uv_mutex_lock(&cache->mutex);
+    if (cache->dir.empty())
+        stats->Set(Nan::New("path").ToLocalChecked(), Nan::Null());
+    else
+        stats->Set(Nan::New("path").ToLocalChecked(), Nan::New(cache->dir).ToLocalChecked());
+    stats->Set(Nan::New("bytes").ToLocalChecked(), Nan::New<Number>(cache->bytes));
+    stats->Set(Nan::New("maxBytes").ToLocalChecked(), Nan::New<Number>(cache->maxBytes));
+    stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New<Number>(cache->hits));
+    stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New<Number>(cache->misses));
+    stats->Set(Nan::New("writes").ToLocalChecked(), Nan::New<Number>(cache->writes));
+    stats->Set(Nan::New("evictions").ToLocalChecked(), Nan::New<Number>(cache->evictions));
+    uv_mutex_unlock(&cache->mutex);
+
+    info.GetReturnValue().Set(stats);
+}
+
+NAN_MODULE_INIT(DiskCache::Init)
+{
+    get();
+    Nan::SetMethod(target, "configureDiskCache", DiskCache::configure);
+    Nan::SetMethod(target, "getDiskCacheStats", DiskCache::getStats);
+}
+} // namespace node
@@ -0,0 +1,54 @@
+#ifndef __DISK_CACHE
+#define __DISK_CACHE
+#include <v8.h>
+#include <nan.h>
+#include <uv.h>
+#include <stdio.h>
+#include <string>
+
+namespace node
+{
+/**
+ * Content addressed cache of encoded renders in a directory.
+ *
+ * Entries are named after SHA-256 of the document content and the
+ * render parameters, so they survive restarts and are shared by all
+ * processes using the same directory. Entries are written to temporary
+ * files and renamed into place. Once the directory grows over its size
+ * limit, least recently used entries (by modification time, refreshed
+ * on every hit) are removed.
+ *
+ * Called on render threads, configured on the main thread.
+ */
+class DiskCache
+{
+  public:
+    static DiskCache *get();
+    static NAN_MODULE_INIT(Init);
+
+    bool isEnabled();
+    std::string entryPath(const std::string &docHash, const std::string &params);
+    bool copyTo(const std::string &path, FILE *dst);
+    void store(const std::string &path, const char *data, size_t length);
+    void storeFile(const std::string &path, const char *srcPath);
+
+  private:
+    DiskCache();
+
+    static NAN_METHOD(configure);
+    static NAN_METHOD(getStats);
+    bool openTemp(const std::string &path, std::string &tmpPath, int *fd);
+    void commit(const std::string &tmpPath, const std::string &path, size_t length);
+    void evict();
+
+    uv_mutex_t mutex;
+    std::string dir;
+    unsigned long long bytes;
+    unsigned long long maxBytes;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long writes;
+    unsigned long evictions;
+};
+} // namespace node
+#endif
@@ -0,0 +1,220 @@
+#include <math.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include <vector>
+#include <poppler/Stream.h>
+#include <poppler/GfxState.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+#include "DraftOutputDev.h"
+
+struct DraftJpegError
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void draftJpegErrorExit(j_common_ptr cinfo)
+{
+    longjmp(((DraftJpegError *)cinfo->err)->jump, 1);
+}
+
+static void draftJpegMessage(j_common_ptr cinfo)
+{
+}
+
+static void draftInitSource(j_decompress_ptr cinfo)
+{
+}
+
+static boolean draftFillInput(j_decompress_ptr cinfo)
+{
+    // truncated data, let libjpeg finish the image
+    static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+static void draftSkipInput(j_decompress_ptr cinfo, long count)
+{
+    if (count <= 0)
+        return;
+    if ((size_t)count > cinfo->src->bytes_in_buffer)
+    {
+        draftFillInput(cinfo);
+        return;
+    }
+    cinfo->src->next_input_byte += count;
+    cinfo->src->bytes_in_buffer -= count;
+}
+
+static void draftTermSource(j_decompress_ptr cinfo)
+{
+}
+
+/**
+ * Decodes JPEG data at 1/denom scale to packed gray or RGB rows.
+ *
+ * Returns false if the data is not a `width` x `height` image of
+ * `components` components or could not be decoded.
+ */
+static bool decodeScaledJpeg(const std::vector<unsigned char> &data, int denom,
+                             int width, int height, int components,
+                             std::vector<unsigned char> &pixels, int *outWidth, int *outHeight)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_source_mgr src;
+    DraftJpegError err;
+
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = draftJpegErrorExit;
+    err.pub.output_message = draftJpegMessage;
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+
+    src.next_input_byte = &data[0];
+    src.bytes_in_buffer = data.size();
+    src.init_source = draftInitSource;
+    src.fill_input_buffer = draftFillInput;
+    src.skip_input_data = draftSkipInput;
+    src.resync_to_restart = jpeg_resync_to_restart;
+    src.term_source = draftTermSource;
+    cinfo.src = &src;
+
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK ||
+        (int)cinfo.image_width != width || (int)cinfo.image_height != height ||
+        cinfo.num_components != components)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    jpeg_start_decompress(&cinfo);
+
+    size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    pixels.resize(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = &pixels[stride * cinfo.output_scanline];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    *outWidth = cinfo.output_width;
+    *outHeight = cinfo.output_height;
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+void DraftOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
+                               int width, int height, GfxImageColorMap *colorMap,
+                               POPPLER_BOOL interpolate, int *maskColors, POPPLER_BOOL inlineImg)
+{
+    // inline image data must be consumed by the parser, masked images
+    // are rare enough in scans
+    if (draft && !inlineImg && maskColors == NULL &&
+        drawScaledJpeg(state, ref, str, width, height, colorMap, interpolate))
+    {
+        return;
+    }
+    SplashOutputDev::drawImage(state, ref, str, width, height, colorMap, interpolate, maskColors, inlineImg);
+}
+
+// block size the encoded data of a DCT image is read in
+static const int JPEG_READ_BLOCK = 64 * 1024;
+
+/**
+ * Draws a DCT image decoded at reduced scale. Returns false if the
+ * image should be drawn as usual.
+ */
+bool DraftOutputDev::drawScaledJpeg(GfxState *state, Object *ref, Stream *str,
+                                    int width, int height, GfxImageColorMap *colorMap,
+                                    POPPLER_BOOL interpolate)
+{
+    int components = colorMap->getNumPixelComps();
+    if (str->getKind() != strDCT || colorMap->getBits() != 8 ||
+        (components != 1 && components != 3) || str->getDict() == NULL)
+    {
+        return false;
+    }
+    // ColorTransform is known to DCTStream only
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object parms;
+    bool hasParms = !str->getDict()->lookup("DecodeParms", &parms)->isNull();
+    parms.free();
+#else
+    bool hasParms = !str->getDict()->lookup("DecodeParms").isNull();
+#endif
+    Stream *raw = str->getNextStream();
+    if (hasParms || raw == NULL)
+    {
+        return false;
+    }
+
+    // image area on the page in device pixels
+    const double *ctm = state->getCTM();
+    double areaWidth = sqrt(ctm[0] * ctm[0] + ctm[1] * ctm[1]);
+    double areaHeight = sqrt(ctm[2] * ctm[2] + ctm[3] * ctm[3]);
+    int denom = 8;
+    while (denom > 1 && ((width + denom - 1) / denom < areaWidth || (height + denom - 1) / denom < areaHeight))
+    {
+        denom /= 2;
+    }
+    if (denom == 1)
+    {
+        return false;
+    }
+
+    // the encoded size, if the stream has a direct Length
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object length;
+    str->getDict()->lookup("Length", &length);
+    int expected = length.isInt() ? length.getInt() : 0;
+    length.free();
+#else
+    Object length = str->getDict()->lookup("Length");
+    int expected = length.isInt() ? length.getInt() : 0;
+#endif
+    std::vector<unsigned char> data;
+    // room for the last block read, so the vector is not reallocated
+    data.reserve((expected > 0 ? (size_t)expected : 0) + JPEG_READ_BLOCK);
+    raw->reset();
+    while (true)
+    {
+        size_t used = data.size();
+        data.resize(used + JPEG_READ_BLOCK);
+        int n = raw->doGetChars(JPEG_READ_BLOCK, &data[used]);
+        data.resize(used + (n > 0 ? n : 0));
+        if (n < JPEG_READ_BLOCK)
+            break;
+    }
+    raw->close();
+
+    std::vector<unsigned char> pixels;
+    int scaledWidth, scaledHeight;
+    if (data.empty() ||
+        !decodeScaledJpeg(data, denom, width, height, components, pixels, &scaledWidth, &scaledHeight))
+    {
+        return false;
+    }
+
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    Object dict;
+    dict.initNull();
+    MemStream *scaled = new MemStream((char *)&pixels[0], 0, pixels.size(), &dict);
+#else
+    MemStream *scaled = new MemStream((char *)&pixels[0], 0, pixels.size(), Object(objNull));
+#endif
+    SplashOutputDev::drawImage(state, ref, scaled, scaledWidth, scaledHeight, colorMap, interpolate, NULL, false);
+    delete scaled;
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef __DRAFT_OUTPUT_DEV
+#define __DRAFT_OUTPUT_DEV
+#include <poppler/poppler-config.h>
+#include <cpp/poppler-version.h>
+#include <poppler/SplashOutputDev.h>
+
+#ifndef POPPLER_BOOL
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 71
+#define POPPLER_BOOL GBool
+#else
+#define POPPLER_BOOL bool
+#endif
+#endif
+
+/**
+ * Splash output device with draft decoding of JPEG images.
+ *
+ * In draft mode DCT images drawn much smaller than their size are
+ * decoded by libjpeg at 1/2, 1/4 or 1/8 scale, the smallest one still
+ * covering the image area on the page, rather than decoded at full
+ * resolution and downsampled by Splash. Other images are drawn as usual.
+ */
+class DraftOutputDev : public SplashOutputDev
+{
+  public:
+    DraftOutputDev(SplashColorMode colorMode, int bitmapRowPad,
+                   POPPLER_BOOL reverseVideo, SplashColorPtr paperColor)
+        : SplashOutputDev(colorMode, bitmapRowPad, reverseVideo, paperColor), draft(false)
+    {
+    }
+
+    void setDraft(bool draft) { this->draft = draft; }
+
+    void drawImage(GfxState *state, Object *ref, Stream *str,
+                   int width, int height, GfxImageColorMap *colorMap,
+                   POPPLER_BOOL interpolate, int *maskColors, POPPLER_BOOL inlineImg) override;
+
+  private:
+    bool drawScaledJpeg(GfxState *state, Object *ref, Stream *str,
+                        int width, int height, GfxImageColorMap *colorMap,
+                        POPPLER_BOOL interpolate);
+
+    bool draft;
+};
+#endif
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+#include "JpegStreamWriter.h"
+
+struct JpegStreamWriterPrivate
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    jmp_buf jump;
+    bool started;
+};
+
+extern "C" {
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    // the default handler calls exit(), unwind to the writer instead
+    JpegStreamWriterPrivate *priv = (JpegStreamWriterPrivate *)cinfo->client_data;
+    longjmp(priv->jump, 1);
+}
+
+static void jpegOutputMessage(j_common_ptr cinfo)
+{
+}
+}
+
+JpegStreamWriter::JpegStreamWriter(Format format)
+    : priv(NULL), format(format), quality(-1), progressive(false),
+      subsampling(SUBSAMPLING_420), dctMethod(DCT_ACCURATE), optimize(false), restartInterval(0)
+{
+}
+
+JpegStreamWriter::~JpegStreamWriter()
+{
+    if (priv)
+    {
+        jpeg_destroy_compress(&priv->cinfo);
+        delete priv;
+    }
+}
+
+void JpegStreamWriter::setQuality(int quality)
+{
+    this->quality = quality;
+}
+
+void JpegStreamWriter::setProgressive(bool progressive)
+{
+    this->progressive = progressive;
+}
+
+void JpegStreamWriter::setSubsampling(Subsampling subsampling)
+{
+    this->subsampling = subsampling;
+}
+
+void JpegStreamWriter::setDctMethod(DctMethod dctMethod)
+{
+    this->dctMethod = dctMethod;
+}
+
+void JpegStreamWriter::setOptimize(bool optimize)
+{
+    this->optimize = optimize;
+}
+
+void JpegStreamWriter::setRestartInterval(int rows)
+{
+    this->restartInterval = rows;
+}
+
+bool JpegStreamWriter::init(FILE *f, int width, int height, IMG_WRITER_DPI hDPI, IMG_WRITER_DPI vDPI)
+{
+    if (f == NULL || priv != NULL)
+        return false;
+
+    priv = new JpegStreamWriterPrivate();
+    priv->started = false;
+    priv->cinfo.err = jpeg_std_error(&priv->jerr);
+    priv->jerr.error_exit = jpegErrorExit;
+    priv->jerr.output_message = jpegOutputMessage;
+    priv->cinfo.client_data = priv;
+    if (setjmp(priv->jump))
+        return false;
+    jpeg_create_compress(&priv->cinfo);
+
+    // jpeg_set_defaults() resets density, quality and coding options,
+    // so the color space goes first and the options after it
+    priv->cinfo.in_color_space = format == GRAY ? JCS_GRAYSCALE : JCS_RGB;
+    priv->cinfo.input_components = format == GRAY ? 1 : 3;
+    jpeg_set_defaults(&priv->cinfo);
+    jpeg_stdio_dest(&priv->cinfo, f);
+
+    priv->cinfo.image_width = width;
+    priv->cinfo.image_height = height;
+    priv->cinfo.density_unit = 1; // dots per inch
+    priv->cinfo.X_density = (UINT16)hDPI;
+    priv->cinfo.Y_density = (UINT16)vDPI;
+
+    if (quality >= 0 && quality <= 100)
+        jpeg_set_quality(&priv->cinfo, quality, TRUE);
+    if (progressive)
+        jpeg_simple_progression(&priv->cinfo);
+
+    if (format == RGB)
+    {
+        // luma sampling factors, chroma components stay at 1x1
+        priv->cinfo.comp_info[0].h_samp_factor = subsampling == SUBSAMPLING_444 ? 1 : 2;
+        priv->cinfo.comp_info[0].v_samp_factor = subsampling == SUBSAMPLING_420 ? 2 : 1;
+    }
+    switch (dctMethod)
+    {
+    case DCT_ACCURATE:
+        priv->cinfo.dct_method = JDCT_ISLOW;
+        break;
+    case DCT_FAST:
+        priv->cinfo.dct_method = JDCT_IFAST;
+        break;
+    case DCT_FLOAT:
+        priv->cinfo.dct_method = JDCT_FLOAT;
+        break;
+    }
+    priv->cinfo.optimize_coding = optimize ? TRUE : FALSE;
+    priv->cinfo.restart_in_rows = restartInterval;
+
+    jpeg_start_compress(&priv->cinfo, TRUE);
+    priv->started = true;
+    return true;
+}
+
+bool JpegStreamWriter::writePointers(unsigned char **rowPointers, int rowCount)
+{
+    if (priv == NULL || !priv->started)
+        return false;
+    if (setjmp(priv->jump))
+    {
+        priv->started = false;
+        return false;
+    }
+    int written = 0;
+    while (written < rowCount)
+    {
+        written += jpeg_write_scanlines(&priv->cinfo, rowPointers + written, rowCount - written);
+    }
+    return true;
+}
+
+bool JpegStreamWriter::writeRow(unsigned char **row)
+{
+    return writePointers(row, 1);
+}
+
+bool JpegStreamWriter::close()
+{
+    if (priv == NULL || !priv->started)
+        return false;
+    if (setjmp(priv->jump))
+    {
+        priv->started = false;
+        return false;
+    }
+    jpeg_finish_compress(&priv->cinfo);
+    priv->started = false;
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef __JPEG_STREAM_WRITER
+#define __JPEG_STREAM_WRITER
+#include <stdio.h>
+#include <cpp/poppler-version.h>
+#include <goo/ImgWriter.h>
+
+#ifndef IMG_WRITER_DPI
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 26
+#define IMG_WRITER_DPI int
+#else
+#define IMG_WRITER_DPI double
+#endif
+#endif
+
+struct JpegStreamWriterPrivate;
+
+/**
+ * JPEG image writer which talks to libjpeg directly.
+ *
+ * Poppler's JpegWriter only exposes quality, progressive mode and
+ * (in newer versions) Huffman optimization. This one also lets callers
+ * pick chroma subsampling, the DCT method and restart intervals. With
+ * default settings the output matches JpegWriter.
+ */
+class JpegStreamWriter : public ImgWriter
+{
+public:
+    enum Format
+    {
+        RGB,
+        GRAY
+    };
+
+    enum Subsampling
+    {
+        SUBSAMPLING_420,
+        SUBSAMPLING_422,
+        SUBSAMPLING_444
+    };
+
+    enum DctMethod
+    {
+        DCT_ACCURATE,
+        DCT_FAST,
+        DCT_FLOAT
+    };
+
+    JpegStreamWriter(Format format = RGB);
+    ~JpegStreamWriter();
+
+    void setQuality(int quality);
+    void setProgressive(bool progressive);
+    void setSubsampling(Subsampling subsampling);
+    void setDctMethod(DctMethod dctMethod);
+    void setOptimize(bool optimize);
+    void setRestartInterval(int rows);
+
+    bool init(FILE *f, int width, int height, IMG_WRITER_DPI hDPI, IMG_WRITER_DPI vDPI) override;
+    bool writePointers(unsigned char **rowPointers, int rowCount) override;
+    bool writeRow(unsigned char **row) override;
+    bool close() override;
+
+private:
+    JpegStreamWriterPrivate *priv;
+    Format format;
+    int quality;
+    bool progressive;
+    Subsampling subsampling;
+    DctMethod dctMethod;
+    bool optimize;
+    int restartInterval;
+};
+#endif
@@ -0,0 +1,40 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const char *fileName, Access access) : data(NULL), length(0)
+{
+    // same file name handling as PDFDocFactory
+    path = strncmp(fileName, "file://", 7) == 0 ? fileName + 7 : fileName;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    // empty files can't be mapped, those are left to regular streams
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            data = (char *)addr;
+            length = (size_t)st.st_size;
+            if (access == ACCESS_RANDOM)
+                madvise(addr, length, MADV_RANDOM);
+            else if (access == ACCESS_SEQUENTIAL)
+                madvise(addr, length, MADV_SEQUENTIAL);
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != NULL)
+        munmap(data, length);
+}
@@ -0,0 +1,40 @@
+#ifndef __MAPPED_FILE
+#define __MAPPED_FILE
+#include <stddef.h>
+#include <string>
+
+/**
+ * Read only memory mapping of a whole document file.
+ *
+ * Documents parse the mapping through a MemStream, so object lookups
+ * are memory reads instead of seek and read calls, and every render
+ * instance of the document and every process opening the same file
+ * share the page cache. The file must not be truncated while it is
+ * mapped.
+ */
+class MappedFile
+{
+  public:
+    // madvise hint for the expected access pattern
+    enum Access
+    {
+        ACCESS_NORMAL,
+        ACCESS_RANDOM,
+        ACCESS_SEQUENTIAL
+    };
+
+    MappedFile(const char *fileName, Access access);
+    ~MappedFile();
+
+    bool isOk() { return data != NULL; }
+    char *getData() { return data; }
+    size_t getLength() { return length; }
+    // path of the file, without 'file://' prefix
+    const std::string &getPath() { return path; }
+
+  private:
+    std::string path;
+    char *data;
+    size_t length;
+};
+#endif
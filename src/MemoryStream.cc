@@ -1,54 +1,231 @@
 #include "MemoryStream.h"
 
-inline OFFSET_TYPE pow2roundup(OFFSET_TYPE x) {
-    --x;
-    x |= x >> 1;
-    x |= x >> 2;
-    x |= x >> 4;
-    x |= x >> 8;
-    x |= x >> 16;
-    x |= x >> 32;
-    return x+1;
+// growth of segments after the first one, bounded to keep slack small
+#define MIN_SEGMENT_SIZE ((OFFSET_TYPE) 64 * 1024)
+#define MAX_SEGMENT_SIZE ((OFFSET_TYPE) 16 * 1024 * 1024)
+
+inline SSIZE_TYPE memory_stream_read(void *cookie, char *buf, SIZE_TYPE size) {
+    return ((Cookie*) cookie)->read(buf, size);
 }
 
 inline SSIZE_TYPE memory_stream_write(void *cookie, const char *buf, SIZE_TYPE size) {
     return ((Cookie*) cookie)->write(buf, size);
 }
 
+#ifdef __linux
+inline SEEK_RETURN_TYPE memory_stream_seek(void *cookie, OFFSET_TYPE *offset, int whence) {
+    OFFSET_TYPE pos = ((Cookie*) cookie)->seek(*offset, whence);
+    if (pos < 0) {
+        return -1;
+    }
+    *offset = pos;
+    return 0;
+}
+#elif __APPLE__
+inline SEEK_RETURN_TYPE memory_stream_seek(void *cookie, OFFSET_TYPE offset, int whence) {
+    return ((Cookie*) cookie)->seek(offset, whence);
+}
+#endif
+
 inline int memory_stream_close(void *cookie) {
     return ((Cookie*) cookie)->close();
 }
 
+inline SSIZE_TYPE Cookie::read(char *buf, SIZE_TYPE size) {
+    return stream->read(buf, size);
+}
+
 inline SSIZE_TYPE Cookie::write(const char *buf, SIZE_TYPE size) {
     return stream->write(buf, size);
 }
 
+inline OFFSET_TYPE Cookie::seek(OFFSET_TYPE offset, int whence) {
+    return stream->seek(offset, whence);
+}
+
 inline int Cookie::close() {
     return stream->close();
 }
 
 FILE* MemoryStream::open() {
 #ifdef __linux
-    cookie_io_functions_t funcs = {NULL, memory_stream_write, NULL, memory_stream_close};
-    return fopencookie((void*) cookie, "wb", funcs);
+    cookie_io_functions_t funcs = {memory_stream_read, memory_stream_write, memory_stream_seek, memory_stream_close};
+    return fopencookie((void*) cookie, "w+b", funcs);
 #elif __APPLE__
-    return funopen((void*) cookie, NULL, memory_stream_write, NULL, memory_stream_close);
+    return funopen((void*) cookie, memory_stream_read, memory_stream_write, memory_stream_seek, memory_stream_close);
 #endif
 }
 
-SSIZE_TYPE MemoryStream::write(const char *buf, SIZE_TYPE size) {
-    if (((OFFSET_TYPE)(offset + size)) > buffer_len) {
-        buffer_len = pow2roundup(offset + size);
-        buffer = (char*) realloc(buffer, buffer_len);
+void MemoryStream::reserve(size_t size) {
+    if (!segments.empty() || size == 0) {
+        return;
+    }
+    grow((OFFSET_TYPE) size);
+}
+
+bool MemoryStream::grow(OFFSET_TYPE end) {
+    while (capacity < end) {
+        OFFSET_TYPE size = capacity < MIN_SEGMENT_SIZE ? MIN_SEGMENT_SIZE :
+            capacity > MAX_SEGMENT_SIZE ? MAX_SEGMENT_SIZE : capacity;
+        if (segments.empty() && end > size) {
+            size = end;
+        }
+        Segment segment = {(char*) malloc(size), capacity, size};
+        if (! segment.data) {
+            return false;
+        }
+        segments.push_back(segment);
+        capacity += size;
+    }
+    return true;
+}
+
+size_t MemoryStream::locate(OFFSET_TYPE pos) {
+    if (current < segments.size() && pos >= segments[current].start &&
+        pos < segments[current].start + segments[current].size) {
+        return current;
+    }
+    size_t lo = 0, hi = segments.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (segments[mid].start <= pos) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    current = lo;
+    return lo;
+}
+
+/**
+ * Copies stored bytes at pos out to dst, or in from src, or zeroes them
+ * when both are NULL. The range must be within capacity.
+ */
+void MemoryStream::copy(OFFSET_TYPE pos, char* dst, const char* src, OFFSET_TYPE size) {
+    while (size > 0) {
+        Segment& segment = segments[locate(pos)];
+        OFFSET_TYPE at = pos - segment.start;
+        OFFSET_TYPE n = segment.size - at < size ? segment.size - at : size;
+        if (dst) {
+            memcpy(dst, segment.data + at, n);
+            dst += n;
+        } else if (src) {
+            memcpy(segment.data + at, src, n);
+            src += n;
+        } else {
+            memset(segment.data + at, 0, n);
+        }
+        pos += n;
+        size -= n;
     }
-    if (! buffer) {
+}
+
+/**
+ * Joins segments into the first one. A heap owned first segment is
+ * resized in place where possible, and later segments are freed as soon
+ * as they are copied, so the peak is the output plus a segment.
+ */
+char* MemoryStream::gather() {
+    if (segments.empty()) {
+        return NULL;
+    }
+    if (segments.size() == 1) {
+        Segment& only = segments[0];
+        if (!external && !buffer_given && only.size > length + MIN_SEGMENT_SIZE) {
+            // give back the slack of an overestimated reserve()
+            char* data = (char*) realloc(only.data, length > 0 ? length : 1);
+            if (data) {
+                only.data = data;
+                only.size = length > 0 ? length : 1;
+                capacity = only.size;
+            }
+        }
+        return only.data;
+    }
+    OFFSET_TYPE size = length > 0 ? length : 1;
+    char* data = (char*) (external ? malloc(size) : realloc(segments[0].data, size));
+    if (! data) {
+        return NULL;
+    }
+    OFFSET_TYPE pos = 0;
+    for (size_t i = 0; i < segments.size() && pos < length; i++) {
+        OFFSET_TYPE n = segments[i].size < length - pos ? segments[i].size : length - pos;
+        if (i > 0 || external) {
+            memcpy(data + pos, segments[i].data, n);
+        }
+        pos += n;
+    }
+    for (size_t i = 1; i < segments.size(); i++) {
+        free(segments[i].data);
+    }
+    segments.clear();
+    Segment segment = {data, 0, size};
+    segments.push_back(segment);
+    capacity = size;
+    current = 0;
+    external = false;
+    return data;
+}
+
+SSIZE_TYPE MemoryStream::read(char *buf, SIZE_TYPE size) {
+    if (offset >= length) {
         return 0;
     }
-    memcpy(buffer + offset, buf, size);
+    if ((OFFSET_TYPE)(offset + size) > length) {
+        size = length - offset;
+    }
+    // bytes past the capacity of an overflown buffer were dropped
+    SIZE_TYPE stored = offset >= capacity ? 0 :
+        (OFFSET_TYPE)(offset + size) > capacity ? capacity - offset : size;
+    copy(offset, buf, NULL, stored);
+    memset(buf + stored, 0, size - stored);
     offset += size;
     return size;
 }
 
+SSIZE_TYPE MemoryStream::write(const char *buf, SIZE_TYPE size) {
+    if (((OFFSET_TYPE)(offset + size)) > capacity && !overflown) {
+        if (external && !growable) {
+            overflown = true;
+        } else if (! grow(offset + size)) {
+            return 0;
+        }
+    }
+    if (offset > length && length < capacity) {
+        // fill the gap left by seeking past the end
+        copy(length, NULL, NULL, (offset < capacity ? offset : capacity) - length);
+    }
+    if (offset < capacity) {
+        copy(offset, NULL, buf, (OFFSET_TYPE)(offset + size) > capacity ? capacity - offset : size);
+    }
+    offset += size;
+    if (offset > length) {
+        length = offset;
+    }
+    return size;
+}
+
+OFFSET_TYPE MemoryStream::seek(OFFSET_TYPE pos, int whence) {
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += offset;
+        break;
+    case SEEK_END:
+        pos += length;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    offset = pos;
+    return offset;
+}
+
 int MemoryStream::close() {
     return 0;
 }
@@ -1,7 +1,9 @@
 #ifndef __MEMORY_STREAM
+#define __MEMORY_STREAM
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #ifdef __linux
 #define SIZE_TYPE size_t
@@ -26,40 +28,98 @@ public:
 
     MemoryStream* getStream() { return stream; };
 
+    SSIZE_TYPE read(char *buf, SIZE_TYPE size);
     SSIZE_TYPE write(const char *buf, SIZE_TYPE size);
+    OFFSET_TYPE seek(OFFSET_TYPE offset, int whence);
     int close();
 
 private:
     MemoryStream* stream;
 };
 
+/**
+ * Growable in-memory stream exposed as a FILE*.
+ *
+ * The stream is seekable and readable, so writers which rewrite
+ * already emitted data (like libtiff does with directory offsets)
+ * can use it the same way as a regular file.
+ *
+ * Data is kept in a list of segments, growing the stream appends a
+ * segment and never moves what was written. Segments are gathered into
+ * a single buffer once, when the buffer is requested. The first segment
+ * may be presized with reserve() from an estimate of the output size.
+ *
+ * The stream may also write into a caller owned buffer of fixed
+ * capacity. Once the output doesn't fit, a growable stream continues
+ * in heap segments, others keep counting the length without storing
+ * data.
+ */
 class MemoryStream
 {
 public:
-    MemoryStream() : buffer_given(false), offset(0), buffer(NULL), buffer_len(0) {
+    MemoryStream() : buffer_given(false), external(false), growable(true), overflown(false),
+        offset(0), length(0), capacity(0), current(0) {
+        cookie = new Cookie(this);
+    };
+
+    MemoryStream(char* buffer, size_t capacity, bool growable) : buffer_given(false), external(true),
+        growable(growable), overflown(false), offset(0), length(0), capacity(capacity), current(0) {
+        Segment segment = {buffer, 0, (OFFSET_TYPE) capacity};
+        segments.push_back(segment);
         cookie = new Cookie(this);
     };
 
     ~MemoryStream() {
-        if (buffer != NULL && !buffer_given) delete buffer;
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (i == 0 && (external || buffer_given)) continue;
+            free(segments[i].data);
+        }
         delete cookie;
     };
 
     FILE* open();
-    OFFSET_TYPE getBufferLen() { return offset; };
+    // allocates the first segment, size is an estimate of the output length
+    void reserve(size_t size);
+    OFFSET_TYPE getBufferLen() { return length; };
+    const char* getBuffer() { return gather(); };
     char* giveBuffer() {
+        char* buffer = gather();
         buffer_given = true;
         return buffer;
     }
+    // output is still in the caller owned buffer
+    bool isExternal() { return external && segments.size() == 1 && !overflown; };
+    // output didn't fit into the caller owned buffer
+    bool hasOverflown() { return overflown; };
 
+    SSIZE_TYPE read(char *buf, SIZE_TYPE size);
     SSIZE_TYPE write(const char *buf, SIZE_TYPE size);
+    OFFSET_TYPE seek(OFFSET_TYPE offset, int whence);
     int close();
 
 private:
+    struct Segment
+    {
+        char* data;
+        OFFSET_TYPE start;
+        OFFSET_TYPE size;
+    };
+
+    bool grow(OFFSET_TYPE end);
+    size_t locate(OFFSET_TYPE pos);
+    void copy(OFFSET_TYPE pos, char* dst, const char* src, OFFSET_TYPE size);
+    char* gather();
+
     bool buffer_given;
+    bool external;
+    bool growable;
+    bool overflown;
     OFFSET_TYPE offset;
-    char* buffer;
-    OFFSET_TYPE buffer_len;
+    OFFSET_TYPE length;
+    OFFSET_TYPE capacity;
+    std::vector<Segment> segments;
+    // segment of the last access, streams are mostly written sequentially
+    size_t current;
     Cookie* cookie;
 };
 #endif
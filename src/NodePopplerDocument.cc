@@ -4,6 +4,9 @@
 
 #include "NodePopplerDocument.h"
 #include "NodePopplerPage.h"
+#include "RenderBatch.h"
+#include "RenderCache.h"
+#include "Sha256.h"
 
 PDFDoc *createMemPDFDoc(
     char *buffer,
@@ -27,6 +30,8 @@ using Nan::To;
 
 namespace node
 {
+static unsigned long nextId = 1;
+
 void NodePopplerDocument::evPageOpened(const NodePopplerPage *p)
 {
     for (int i = 0; i < pages->getLength(); i++)
@@ -62,14 +67,47 @@ void NodePopplerDocument::evPageClosed(const NodePopplerPage *p)
 NodePopplerDocument::NodePopplerDocument(
     const char *cFileName,
     GooString* ownerPassword,
-    GooString* userPassword)
+    GooString* userPassword,
+    bool map,
+    MappedFile::Access access)
 {
     doc = NULL;
     buffer = NULL;
+    length = 0;
+    ownsBuffer = false;
+    mapped = NULL;
+    this->ownerPassword = ownerPassword;
+    this->userPassword = userPassword;
 
-    GooString *fileNameA = new GooString(cFileName);
+    fileName = new GooString(cFileName);
+    id = nextId++;
+    generation = 0;
+    hashed = false;
+    uv_mutex_init(&hashMutex);
+    uv_mutex_init(&annotMutex);
 
-    doc = PDFDocFactory().createPDFDoc(*fileNameA, ownerPassword, userPassword);
+    if (map)
+    {
+        mapped = new MappedFile(cFileName, access);
+        if (!mapped->isOk())
+        {
+            // let the regular stream report why the file can't be read
+            delete mapped;
+            mapped = NULL;
+        }
+    }
+    if (mapped)
+    {
+        // render instances parse the same mapping
+        buffer = mapped->getData();
+        length = mapped->getLength();
+        doc = createMemPDFDoc(buffer, length, ownerPassword, userPassword);
+    }
+    else
+    {
+        doc = PDFDocFactory().createPDFDoc(*fileName, ownerPassword, userPassword);
+    }
+    rendererPool = new RendererPool(openInstance, this);
 
     pages = new GooList();
 }
@@ -78,26 +116,149 @@ NodePopplerDocument::NodePopplerDocument(
     char *buffer,
     size_t length,
     GooString* ownerPassword,
-    GooString* userPassword)
+    GooString* userPassword,
+    bool copy)
 {
     doc = NULL;
-    this->buffer = NULL;
-    this->buffer = new char[length];
-    std::memcpy(this->buffer, buffer, length);
+    fileName = NULL;
+    mapped = NULL;
+    this->ownerPassword = ownerPassword;
+    this->userPassword = userPassword;
+    this->length = length;
+    this->ownsBuffer = copy;
+    if (copy)
+    {
+        this->buffer = new char[length];
+        std::memcpy(this->buffer, buffer, length);
+    }
+    else
+    {
+        // parsed in place, the caller keeps the memory alive through bufferHandle
+        this->buffer = buffer;
+    }
+    id = nextId++;
+    generation = 0;
+    hashed = false;
+    uv_mutex_init(&hashMutex);
+    uv_mutex_init(&annotMutex);
     doc = createMemPDFDoc(this->buffer, length, ownerPassword, userPassword);
+    rendererPool = new RendererPool(openInstance, this);
     pages = new GooList();
 }
 
+/**
+     * Opens one more independent instance of this document for
+     * rendering on a worker thread, with annotation changes made so far
+     * applied to it
+     */
+PDFDoc *NodePopplerDocument::openInstance(void *data, unsigned long *generation)
+{
+    NodePopplerDocument *self = (NodePopplerDocument *)data;
+    uv_mutex_lock(&self->annotMutex);
+    std::vector<AnnotChange> changes = self->annotChanges;
+    *generation = self->generation;
+    uv_mutex_unlock(&self->annotMutex);
+
+    PDFDoc *doc;
+    if (self->buffer)
+    {
+        doc = createMemPDFDoc(self->buffer, self->length, self->ownerPassword, self->userPassword);
+    }
+    else
+    {
+        doc = PDFDocFactory().createPDFDoc(*self->fileName, self->ownerPassword, self->userPassword);
+    }
+    if (doc->isOk())
+    {
+        for (size_t i = 0; i < changes.size(); i++)
+        {
+            Page *pg = doc->getPage(changes[i].page);
+            if (pg && pg->isOk())
+                NodePopplerPage::applyAnnotChange(doc, pg, changes[i]);
+        }
+    }
+    return doc;
+}
+
+/**
+     * Records an annotation change applied to the main thread document,
+     * so renderers opened from now on apply it too
+     */
+void NodePopplerDocument::recordAnnotChange(const AnnotChange &change)
+{
+    uv_mutex_lock(&annotMutex);
+    annotChanges.push_back(change);
+    generation++;
+    uv_mutex_unlock(&annotMutex);
+    rendererPool->setGeneration(generation);
+}
+
+/**
+     * SHA-256 of the document file or buffer, computed on first use.
+     * Empty if the file can't be read.
+     */
+const std::string &NodePopplerDocument::getContentHash()
+{
+    uv_mutex_lock(&hashMutex);
+    if (!hashed)
+    {
+        Sha256 sha;
+        if (buffer)
+        {
+            sha.update(buffer, length);
+            contentHash = sha.hexDigest();
+        }
+        else
+        {
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 72
+            FILE *f = fopen(fileName->getCString(), "rb");
+#else
+            FILE *f = fopen(fileName->c_str(), "rb");
+#endif
+            if (f != NULL)
+            {
+                char chunk[65536];
+                size_t n;
+                while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+                {
+                    sha.update(chunk, n);
+                }
+                if (!ferror(f))
+                {
+                    contentHash = sha.hexDigest();
+                }
+                fclose(f);
+            }
+        }
+        hashed = true;
+    }
+    uv_mutex_unlock(&hashMutex);
+    return contentHash;
+}
+
 NodePopplerDocument::~NodePopplerDocument()
 {
     for (int i = 0; i < pages->getLength(); i++)
     {
         ((NodePopplerPage *)pages->get(i))->evDocumentClosed();
     }
+    RenderCache::get()->dropDocument(id);
+    uv_mutex_destroy(&hashMutex);
+    delete rendererPool;
+    uv_mutex_destroy(&annotMutex);
     if (doc)
         delete doc;
-    if (buffer)
-        delete buffer;
+    if (buffer && ownsBuffer)
+        delete[] buffer;
+    if (mapped)
+        delete mapped;
+    bufferHandle.Reset();
+    if (fileName)
+        delete fileName;
+    if (ownerPassword)
+        delete ownerPassword;
+    if (userPassword)
+        delete userPassword;
     delete pages;
 }
 
@@ -111,6 +272,8 @@ NAN_MODULE_INIT(NodePopplerDocument::Init)
     NODE_DEFINE_CONSTANT(target, POPPLER_VERSION_MINOR);
     NODE_DEFINE_CONSTANT(target, POPPLER_VERSION_MICRO);
 
+    Nan::SetPrototypeMethod(tpl, "renderPages", NodePopplerDocument::renderPages);
+
     Nan::SetAccessor(tpl->InstanceTemplate(),
                      Nan::New<String>("pageCount").ToLocalChecked(),
                      NodePopplerDocument::paramsGetter);
@@ -174,7 +337,12 @@ NAN_GETTER(NodePopplerDocument::paramsGetter)
     else if (strcmp(*propName, "fileName") == 0)
     {
         auto fileName = self->doc->getFileName();
-        if (fileName != NULL)
+        if (self->mapped != NULL)
+        {
+            // documents over a mapping have no file stream
+            info.GetReturnValue().Set(Nan::New<String>(self->mapped->getPath()).ToLocalChecked());
+        }
+        else if (fileName != NULL)
         {
 #if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 72
             auto c_str = fileName->getCString();
@@ -195,17 +363,186 @@ NAN_GETTER(NodePopplerDocument::paramsGetter)
     }
 }
 
+/**
+     * Renders a list of pages to Buffers
+     *
+     * Javascript function
+     *
+     * \param pages Array of page numbers.
+     * \param method String \see NodePopplerPage::renderToFile
+     * \param PPI Number \see NodePopplerPage::renderToFile
+     * \param options Object \see NodePopplerPage::renderToFile with additional fields:
+     *   parallelism: Integer - number of pages rendered at once (default is
+     *              the render pool size)
+     *   onPage: Function - called as `onPage(err, result)` for every page
+     *              as soon as it is rendered. Results are not collected then.
+     * \param callback Function. Called with an Array of `renderToBuffer` results
+     *              (each extended with `page` field) once all pages are rendered.
+     */
+NAN_METHOD(NodePopplerDocument::renderPages)
+{
+    Nan::HandleScope scope;
+    NodePopplerDocument *self = Nan::ObjectWrap::Unwrap<NodePopplerDocument>(info.Holder());
+
+    if (info.Length() < 4 || !info[0]->IsArray() || !info[info.Length() - 1]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (pages: Array, method: String, PPI: Number[, options: Object], callback: Function)");
+    }
+
+    Local<v8::Function> callbackHandle = info[info.Length() - 1].As<v8::Function>();
+    Local<v8::Array> pageNums = Local<v8::Array>::Cast(info[0]);
+    size_t parallelism = RendererPool::getCapacity();
+    Nan::Callback *onPage = NULL;
+    const char *e = NULL;
+
+    NodePopplerPage::RenderWork *settings = new NodePopplerPage::RenderWork(self, NULL, NodePopplerPage::DEST_BUFFER);
+    settings->setWriter(info[1]);
+    if (!settings->error)
+    {
+        settings->setPPI(info[2]);
+    }
+    if (!settings->error && info.Length() > 4 && info[3]->IsObject())
+    {
+        Local<v8::Object> options = To<v8::Object>(info[3]).ToLocalChecked();
+        Local<String> pk = Nan::New("parallelism").ToLocalChecked();
+        Local<String> ok = Nan::New("onPage").ToLocalChecked();
+        if (options->Has(pk))
+        {
+            Local<Value> pv = options->Get(pk);
+            if (pv->IsUint32() && To<uint32_t>(pv).FromJust() > 0)
+            {
+                parallelism = To<uint32_t>(pv).FromJust();
+            }
+            else
+            {
+                e = "'parallelism' option value must be a positive integer";
+            }
+        }
+        if (options->Has(ok))
+        {
+            Local<Value> ov = options->Get(ok);
+            if (ov->IsFunction())
+            {
+                onPage = new Nan::Callback(ov.As<v8::Function>());
+            }
+            else
+            {
+                e = "'onPage' option must be an instance of Function";
+            }
+        }
+        settings->setWriterOptions(info[3]);
+    }
+    if (settings->error)
+    {
+        e = settings->error;
+    }
+
+    RenderBatch *batch = new RenderBatch(info.Holder(), parallelism);
+    batch->callback = new Nan::Callback(callbackHandle);
+    batch->onPage = onPage;
+    for (uint32_t i = 0; e == NULL && i < pageNums->Length(); i++)
+    {
+        Local<Value> num = pageNums->Get(i);
+        if (!num->IsUint32() || To<uint32_t>(num).FromJust() == 0 || (int)To<uint32_t>(num).FromJust() > self->doc->getNumPages())
+        {
+            e = "Page number out of bounds.";
+            break;
+        }
+        Page *pg = self->doc->getPage(To<uint32_t>(num).FromJust());
+        if (!pg || !pg->isOk())
+        {
+            e = "Can't open page.";
+            break;
+        }
+        NodePopplerPage::RenderWork *work = new NodePopplerPage::RenderWork(self, pg, NodePopplerPage::DEST_BUFFER);
+        work->copySettings(settings);
+        work->annotated = self->getGeneration() > 0;
+        work->cancelFlag = &settings->cancelled;
+        batch->works.push_back(work);
+    }
+
+    if (e)
+    {
+        Local<Value> argv[] = {Nan::Error(e)};
+        delete batch;
+        delete settings;
+        Nan::TryCatch try_catch;
+        Nan::Call(callbackHandle, Nan::GetCurrentContext()->Global(), 1, argv);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+        return;
+    }
+    batch->settings = settings;
+
+    batch->start();
+}
+
 NAN_METHOD(NodePopplerDocument::New)
 {
     Nan::HandleScope scope;
 
     if (
-        !(0 < info.Length() && info.Length() <= 3)
-        || !(info[0]->IsString() || Buffer::HasInstance(info[0]))
+        !(0 < info.Length() && info.Length() <= 4)
+        || !(info[0]->IsString() || Buffer::HasInstance(info[0]) || info[0]->IsArrayBuffer()
+#if NODE_VERSION_MAJOR >= 8
+             || info[0]->IsSharedArrayBuffer()
+#endif
+             )
         || !(info[1]->IsUndefined() || info[1]->IsNull() || info[1]->IsString())
-        || !(info[2]->IsUndefined() || info[2]->IsNull() || info[2]->IsString()))
+        || !(info[2]->IsUndefined() || info[2]->IsNull() || info[2]->IsString())
+        || !(info[3]->IsUndefined() || info[3]->IsNull() || info[3]->IsObject()))
+    {
+        return Nan::ThrowError("Supported arguments: (fileName: string | Buffer | ArrayBuffer | SharedArrayBuffer, userPassword?: string, ownerPassword?: string, options?: Object).");
+    }
+
+    bool copy = true;
+    bool map = false;
+    MappedFile::Access access = MappedFile::ACCESS_NORMAL;
+    if (info[3]->IsObject())
+    {
+        Local<v8::Object> options = To<v8::Object>(info[3]).ToLocalChecked();
+        Local<Value> copyVal = Nan::Get(options, Nan::New("copy").ToLocalChecked()).ToLocalChecked();
+        if (!copyVal->IsUndefined())
+        {
+            if (!copyVal->IsBoolean())
+            {
+                return Nan::ThrowTypeError("'copy' option value must be a boolean value");
+            }
+            copy = Nan::To<bool>(copyVal).FromJust();
+        }
+        Local<Value> mapVal = Nan::Get(options, Nan::New("mmap").ToLocalChecked()).ToLocalChecked();
+        if (!mapVal->IsUndefined())
+        {
+            if (!mapVal->IsBoolean())
+            {
+                return Nan::ThrowTypeError("'mmap' option value must be a boolean value");
+            }
+            map = Nan::To<bool>(mapVal).FromJust();
+        }
+        Local<Value> accessVal = Nan::Get(options, Nan::New("access").ToLocalChecked()).ToLocalChecked();
+        if (!accessVal->IsUndefined())
+        {
+            if (!accessVal->IsString())
+            {
+                return Nan::ThrowTypeError("'access' option must be an instance of string");
+            }
+            Nan::Utf8String accessStr(accessVal);
+            if (strcmp(*accessStr, "normal") == 0)
+                access = MappedFile::ACCESS_NORMAL;
+            else if (strcmp(*accessStr, "random") == 0)
+                access = MappedFile::ACCESS_RANDOM;
+            else if (strcmp(*accessStr, "sequential") == 0)
+                access = MappedFile::ACCESS_SEQUENTIAL;
+            else
+                return Nan::ThrowError("Unsupported 'access' option value");
+        }
+    }
+    // a reference can't stop an ArrayBuffer from being detached and freed
+    if (!copy && info[0]->IsArrayBuffer())
     {
-        return Nan::ThrowError("Supported arguments: (fileName: string | Buffer, userPassword?: string, ownerPassword?: string).");
+        return Nan::ThrowError("'copy' option value false is not supported for ArrayBuffer, use a Buffer or SharedArrayBuffer");
     }
 
     NodePopplerDocument *doc;
@@ -226,19 +563,34 @@ NAN_METHOD(NodePopplerDocument::New)
     if (info[0]->IsString())
     {
         Nan::Utf8String str(To<String>(info[0]).ToLocalChecked());
-        doc = new NodePopplerDocument(*str, ownerPassword, userPassword);
+        doc = new NodePopplerDocument(*str, ownerPassword, userPassword, map, access);
     }
-    else if (Buffer::HasInstance(info[0]))
+    else
     {
+        // array buffers are read through a view over all of their bytes
+        Local<Value> data = info[0];
+        if (info[0]->IsArrayBuffer())
+        {
+            Local<ArrayBuffer> ab = info[0].As<ArrayBuffer>();
+            data = Uint8Array::New(ab, 0, ab->ByteLength());
+        }
+#if NODE_VERSION_MAJOR >= 8
+        else if (info[0]->IsSharedArrayBuffer())
+        {
+            Local<SharedArrayBuffer> sab = info[0].As<SharedArrayBuffer>();
+            data = Uint8Array::New(sab, 0, sab->ByteLength());
+        }
+#endif
         doc = new NodePopplerDocument(
-            Buffer::Data(info[0]),
-            Buffer::Length(info[0]),
+            Buffer::Data(data),
+            Buffer::Length(data),
             userPassword,
-            ownerPassword);
-    }
-    else
-    {
-        return Nan::ThrowTypeError("'filename' must be an instance of String or Buffer.");
+            ownerPassword,
+            copy);
+        if (!copy)
+        {
+            doc->bufferHandle.Reset(To<v8::Object>(info[0]).ToLocalChecked());
+        }
     }
 
     if (!doc->isOk())
@@ -8,20 +8,43 @@
 #include <poppler/PDFDocFactory.h>
 #include <goo/GooString.h>
 #include <goo/GooList.h>
+#include <uv.h>
+#include <string>
+#include <vector>
+
+#include "RendererPool.h"
+#include "MappedFile.h"
 
 namespace node {
     class NodePopplerPage;
+
+    /**
+     * Annotation change made through a page, replayed on the document
+     * instances of renderers
+     */
+    struct AnnotChange {
+        int page;
+        // deleteAnnots, otherwise a highlight added by addAnnot
+        bool remove;
+        // 8 coordinates per quadrilateral
+        std::vector<double> quads;
+        double r, g, b;
+    };
+
     class NodePopplerDocument : public Nan::ObjectWrap {
     public:
         NodePopplerDocument(
             const char* cFileName,
             GooString* ownerPassword = nullptr,
-            GooString* userPassword = nullptr);
+            GooString* userPassword = nullptr,
+            bool map = false,
+            MappedFile::Access access = MappedFile::ACCESS_NORMAL);
         NodePopplerDocument(
             char* buffer,
             size_t length,
             GooString* ownerPassword = nullptr,
-            GooString* userPassword = nullptr);
+            GooString* userPassword = nullptr,
+            bool copy = true);
         ~NodePopplerDocument();
 
         inline bool isOk() {
@@ -30,19 +53,53 @@ namespace node {
         inline PDFDoc *getDoc() {
             return doc;
         }
+        inline RendererPool *getRendererPool() {
+            return rendererPool;
+        }
+        inline unsigned long getId() {
+            return id;
+        }
+        /**
+         * Number of annotation changes made through any page
+         */
+        inline unsigned long getGeneration() {
+            return generation;
+        }
+        void recordAnnotChange(const AnnotChange &change);
+        const std::string &getContentHash();
         static NAN_MODULE_INIT(Init);
 
     protected:
         static NAN_METHOD(New);
+        static NAN_METHOD(renderPages);
         void evPageOpened(const NodePopplerPage *p);
         void evPageClosed(const NodePopplerPage *p);
         GooList *pages;
 
     private:
         static NAN_GETTER(paramsGetter);
+        static PDFDoc *openInstance(void *data, unsigned long *generation);
 
         friend class NodePopplerPage;
         PDFDoc *doc;
+        RendererPool *rendererPool;
+        GooString *fileName;
+        GooString *ownerPassword;
+        GooString *userPassword;
         char *buffer;
+        size_t length;
+        // buffer is a private copy rather than memory of bufferHandle
+        bool ownsBuffer;
+        Nan::Persistent<v8::Object> bufferHandle;
+        // mapping of a file document, buffer points into it
+        MappedFile *mapped;
+        unsigned long id;
+        unsigned long generation;
+        // changes made to doc, guarded by annotMutex with generation
+        std::vector<AnnotChange> annotChanges;
+        uv_mutex_t annotMutex;
+        uv_mutex_t hashMutex;
+        bool hashed;
+        std::string contentHash;
     };
 }
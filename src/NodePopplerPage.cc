@@ -1,10 +1,15 @@
 #include <v8.h>
 #include <memory>
+#include <vector>
+#include <limits.h>
 #include <node.h>
 #include <node_buffer.h>
 
 #include "NodePopplerDocument.h"
 #include "NodePopplerPage.h"
+#include "TileRender.h"
+#include "VariantRender.h"
+#include "CostEstimator.h"
 
 #define THROW_SYNC_ASYNC_ERR(work, err)      \
     if (work->callback == NULL)              \
@@ -40,6 +45,10 @@ NAN_MODULE_INIT(NodePopplerPage::Init)
 
     Nan::SetPrototypeMethod(tpl, "renderToFile", NodePopplerPage::renderToFile);
     Nan::SetPrototypeMethod(tpl, "renderToBuffer", NodePopplerPage::renderToBuffer);
+    Nan::SetPrototypeMethod(tpl, "renderToChunks", NodePopplerPage::renderToChunks);
+    Nan::SetPrototypeMethod(tpl, "renderTiles", NodePopplerPage::renderTiles);
+    Nan::SetPrototypeMethod(tpl, "renderVariants", NodePopplerPage::renderVariants);
+    Nan::SetPrototypeMethod(tpl, "estimateCost", NodePopplerPage::estimateCost);
     Nan::SetPrototypeMethod(tpl, "findText", NodePopplerPage::findText);
     Nan::SetPrototypeMethod(tpl, "getWordList", NodePopplerPage::getWordList);
 #if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 20
@@ -300,6 +309,59 @@ NAN_METHOD(NodePopplerPage::getWordList)
     info.GetReturnValue().Set(v8results);
 }
 
+/**
+     * Estimates cost of rendering the page by scanning its content
+     * streams and resources without rasterizing
+     *
+     * Javascript function
+     *
+     * \param PPI Number. Pixel per inch value for predicted output size (default 72).
+     *
+     * \return Object with operator, image, font and transparency group
+     *   counts, decoded image pixels and output pixels at the PPI
+     */
+NAN_METHOD(NodePopplerPage::estimateCost)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    if (self->isDocClosed())
+    {
+        return Nan::ThrowError("Document closed. You must delete this page");
+    }
+    double PPI = 72;
+    if (info.Length() > 0 && !info[0]->IsUndefined())
+    {
+        if (!info[0]->IsNumber())
+        {
+            return Nan::ThrowTypeError("'PPI' must be an instance of number");
+        }
+        PPI = To<double>(info[0]).FromJust();
+        if (0 > PPI)
+        {
+            return Nan::ThrowError("'PPI' value must be greater then 0");
+        }
+    }
+
+    CostEstimator estimator(self->doc->getXRef());
+    PageCost cost = estimator.estimate(self->pg);
+
+    double scale = PPI / 72.0;
+    double outputPixels = (double)(int)(self->getWidth() * scale) * (int)(self->getHeight() * scale);
+
+    Local<v8::Object> out = Nan::New<v8::Object>();
+    out->Set(Nan::New("operators").ToLocalChecked(), Nan::New<Number>(cost.operators));
+    out->Set(Nan::New("pathOperators").ToLocalChecked(), Nan::New<Number>(cost.pathOperators));
+    out->Set(Nan::New("textOperators").ToLocalChecked(), Nan::New<Number>(cost.textOperators));
+    out->Set(Nan::New("shadings").ToLocalChecked(), Nan::New<Number>(cost.shadings));
+    out->Set(Nan::New("images").ToLocalChecked(), Nan::New<Number>(cost.images));
+    out->Set(Nan::New("imagePixels").ToLocalChecked(), Nan::New<Number>(cost.imagePixels));
+    out->Set(Nan::New("fonts").ToLocalChecked(), Nan::New<Number>(cost.fonts));
+    out->Set(Nan::New("transparencyGroups").ToLocalChecked(), Nan::New<Number>(cost.transparencyGroups));
+    out->Set(Nan::New("outputPixels").ToLocalChecked(), Nan::New<Number>(outputPixels));
+    info.GetReturnValue().Set(out);
+}
+
 /**
      * \return Object Relative coors from lower left corner
      */
@@ -376,28 +438,88 @@ NAN_METHOD(NodePopplerPage::deleteAnnots)
     Nan::HandleScope scope;
     NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
 
-    while (true)
+    if (self->isDocClosed())
     {
-        Annots *annots = self->pg->getAnnots();
-        int num_annots = annots->getNumAnnots();
-        if (num_annots > 0)
+        return Nan::ThrowError("Document closed. You must delete this page");
+    }
+
+    AnnotChange change;
+    change.page = self->pg->getNum();
+    change.remove = true;
+    change.r = change.g = change.b = 0;
+    if (applyAnnotChange(self->doc, self->pg, change))
+    {
+        self->parent->recordAnnotChange(change);
+    }
+
+    info.GetReturnValue().Set(Nan::Null());
+}
+#endif
+
+/**
+     * Applies an annotation change to a page of a document instance,
+     * the main thread one or one of a renderer
+     *
+     * \return true if the page changed
+     */
+bool NodePopplerPage::applyAnnotChange(PDFDoc *doc, Page *pg, const AnnotChange &change)
+{
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 20
+    return false;
+#else
+    if (change.remove)
+    {
+        // typeHighlight annotations from end of the annotations array
+        bool removed = false;
+        while (true)
         {
+            Annots *annots = pg->getAnnots();
+            int num_annots = annots->getNumAnnots();
+            if (num_annots == 0)
+                break;
             Annot *annot = annots->getAnnot(num_annots - 1);
             if (annot->getType() != Annot::typeHighlight)
-            {
                 break;
-            }
-            self->pg->removeAnnot(annot);
-        }
-        else
-        {
-            break;
+            pg->removeAnnot(annot);
+            removed = true;
         }
+        return removed;
     }
 
-    info.GetReturnValue().Set(Nan::Null());
-}
+    ::Array *array = new ::Array(doc->getXRef());
+    for (size_t i = 0; i < change.quads.size(); i++)
+    {
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+        array->add((new ::Object())->initReal(change.quads[i]));
+#else
+        array->add(::Object(change.quads[i]));
+#endif
+    }
+
+    PDFRectangle *rect = new PDFRectangle(0, 0, 0, 0);
+    AnnotQuadrilaterals *aq = new AnnotQuadrilaterals(array, rect);
+#if POPPLER_VERSION_MAJOR == 0 && (POPPLER_VERSION_MINOR < 23 || (POPPLER_VERSION_MINOR == 23 && POPPLER_VERSION_MICRO < 3))
+    AnnotTextMarkup *annot = new AnnotTextMarkup(doc, rect, Annot::typeHighlight, aq);
+#else
+    AnnotTextMarkup *annot = new AnnotTextMarkup(doc, rect, Annot::typeHighlight);
+    annot->setQuadrilaterals(aq);
+#endif
+
+    annot->setOpacity(.5);
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 70
+    annot->setColor(new AnnotColor(change.r, change.g, change.b));
+#else
+    auto new_color = std::unique_ptr<AnnotColor>(new AnnotColor(change.r, change.g, change.b));
+    annot->setColor(std::move(new_color));
+#endif
+    pg->addAnnot(annot);
+
+    delete array;
+    delete rect;
+    delete aq;
+    return true;
 #endif
+}
 
 #if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR >= 20
 /**
@@ -463,60 +585,25 @@ void NodePopplerPage::addAnnot(const Local<v8::Array> v8array, char **error)
 
     double x1, y1, x2, y2, x3, y3, x4, y4;
     int len = v8array->Length();
-    ::Array *array = new ::Array(doc->getXRef());
+    AnnotChange change;
+    change.page = pg->getNum();
+    change.remove = false;
+    change.r = color_r;
+    change.g = color_g;
+    change.b = color_b;
     for (int i = 0; i < len; i++)
     {
         parseAnnot(v8array->Get(i), &x1, &y1, &x2, &y2, &x3, &y3, &x4, &y4, error);
         if (*error)
         {
-            delete array;
             return;
         }
-        else
-        {
-#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
-            array->add((new ::Object())->initReal(x1));
-            array->add((new ::Object())->initReal(y1));
-            array->add((new ::Object())->initReal(x2));
-            array->add((new ::Object())->initReal(y2));
-            array->add((new ::Object())->initReal(x3));
-            array->add((new ::Object())->initReal(y3));
-            array->add((new ::Object())->initReal(x4));
-            array->add((new ::Object())->initReal(y4));
-#else
-            array->add(::Object(x1));
-            array->add(::Object(y1));
-            array->add(::Object(x2));
-            array->add(::Object(y2));
-            array->add(::Object(x3));
-            array->add(::Object(y3));
-            array->add(::Object(x4));
-            array->add(::Object(y4));
-#endif
-        }
+        double quad[] = {x1, y1, x2, y2, x3, y3, x4, y4};
+        change.quads.insert(change.quads.end(), quad, quad + 8);
     }
 
-    PDFRectangle *rect = new PDFRectangle(0, 0, 0, 0);
-    AnnotQuadrilaterals *aq = new AnnotQuadrilaterals(array, rect);
-#if POPPLER_VERSION_MAJOR == 0 && (POPPLER_VERSION_MINOR < 23 || (POPPLER_VERSION_MINOR == 23 && POPPLER_VERSION_MICRO < 3))
-    AnnotTextMarkup *annot = new AnnotTextMarkup(doc, rect, Annot::typeHighlight, aq);
-#else
-    AnnotTextMarkup *annot = new AnnotTextMarkup(doc, rect, Annot::typeHighlight);
-    annot->setQuadrilaterals(aq);
-#endif
-
-    annot->setOpacity(.5);
-#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 70
-    annot->setColor(new AnnotColor(color_r, color_g, color_b));
-#else
-    auto new_color = std::unique_ptr<AnnotColor>(new AnnotColor(color_r, color_g, color_b));
-    annot->setColor(std::move(new_color));
-#endif
-    pg->addAnnot(annot);
-
-    delete array;
-    delete rect;
-    delete aq;
+    applyAnnotChange(doc, pg, change);
+    parent->recordAnnotChange(change);
 }
 #endif
 
@@ -591,71 +678,232 @@ void NodePopplerPage::parseAnnot(const Local<Value> rect,
     }
 }
 
+// Gfx calls the abort check once in this many operations
+static const unsigned long OPERATIONS_PER_ABORT_CHECK = 11;
+
 /**
-     * Displaying page slice to stream work->f
+     * Called by poppler between drawing operations, stops rendering
+     * once the work is cancelled or over its budget
      */
-void NodePopplerPage::display(RenderWork *work)
-{
-    SplashColor paperColor;
-    paperColor[0] = 255;
-    paperColor[1] = 255;
-    paperColor[2] = 255;
-    SplashOutputDev *splashOut = new SplashOutputDev(
-        splashModeRGB8,
-        4, false,
-        paperColor);
-#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 19
-    splashOut->startDoc(work->self->doc->getXRef());
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 71
+static GBool abortCheck(void *data)
 #else
-    splashOut->startDoc(work->self->doc);
+static bool abortCheck(void *data)
 #endif
-    ImgWriter *writer = NULL;
-    switch (work->w)
+{
+    NodePopplerPage::RenderWork *work = static_cast<NodePopplerPage::RenderWork *>(data);
+    return work->isCancelled() || work->isOverLimit();
+}
+
+/**
+     * Rasterizes page slice of the work.
+     *
+     * Returns output device holding the bitmap, or NULL with work->error
+     * set. The renderer must be released by the caller once the bitmap
+     * is consumed.
+     */
+SplashOutputDev *NodePopplerPage::rasterize(RenderWork *work, RendererPool::Renderer **rendererOut)
+{
+    int sx, sy, sw, sh;
+    std::tie(sx, sy, sw, sh) = work->applyScale();
+    if (work->error)
+        return NULL;
+    return rasterizeRect(work, sx, sy, sw, sh, rendererOut);
+}
+
+/**
+     * Rasterizes a rectangle of the page in device pixels at the PPI of
+     * the work, \see NodePopplerPage::rasterize
+     */
+SplashOutputDev *NodePopplerPage::rasterizeRect(RenderWork *work, int sx, int sy, int sw, int sh, RendererPool::Renderer **rendererOut)
+{
+    RendererPool *pool = work->parent->getRendererPool();
+    RendererPool::Renderer *renderer = pool->acquire();
+    if (renderer == NULL)
     {
-    case W_PNG:
-        writer = new PNGWriter();
-        break;
-    case W_JPEG:
-        writer = new JpegWriter(work->quality, work->progressive);
-        break;
-    case W_TIFF:
-#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 21
-        writer = new TiffWriter();
-        ((TiffWriter *)writer)->setSplashMode(splashModeRGB8);
+        work->setError("Could not open document for rendering");
+        return NULL;
+    }
+    Page *pg = renderer->doc->getPage(work->pg->getNum());
+    if (pg == NULL || !pg->isOk())
+    {
+        pool->release(renderer);
+        work->setError("Can't open page.");
+        return NULL;
+    }
+    DraftOutputDev *splashOut = renderer->getOutputDev(work->getDeviceSettings());
+    splashOut->setDraft(work->draft);
+    if (work->renderStart == 0)
+    {
+        // budgets cover all rasterizations of the work
+        work->renderStart = uv_hrtime();
+    }
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 19
+    pg->displaySlice(splashOut, work->PPI, work->PPI,
+                     0, false, true,
+                     sx, sy, sw, sh,
+                     false, renderer->doc->getCatalog(),
+                     abortCheck, work, NULL, NULL);
 #else
-        writer = new TiffWriter(TiffWriter::RGB);
+    pg->displaySlice(splashOut, work->PPI, work->PPI,
+                     0, false, true,
+                     sx, sy, sw, sh,
+                     false, abortCheck, work);
 #endif
-        if (work->compression != NULL)
+    if (work->checkCancelled() || work->checkLimits())
+    {
+        // the bitmap is incomplete, don't encode it
+        pool->release(renderer);
+        return NULL;
+    }
+    *rendererOut = renderer;
+    return splashOut;
+}
+
+/**
+     * Rasterizes the rectangle in bands of `rows` rows and feeds each
+     * band to the writer as it finishes, so only one band is held in
+     * memory at a time.
+     *
+     * Sets work->error and returns splashOk if a band could not be
+     * rasterized (e.g. the work was cancelled).
+     */
+SplashError NodePopplerPage::displayBands(RenderWork *work, ImgWriter *writer, int sx, int sy, int sw, int sh, int rows)
+{
+    RendererPool *pool = work->parent->getRendererPool();
+    if (!writer->init(work->f, sw, sh, (int)work->PPI, (int)work->PPI))
+        return splashErrGeneric;
+    for (int y = 0; y < sh; y += rows)
+    {
+        int bandRows = rows < sh - y ? rows : sh - y;
+        RendererPool::Renderer *renderer;
+        SplashOutputDev *splashOut = rasterizeRect(work, sx, sy + y, sw, bandRows, &renderer);
+        if (splashOut == NULL)
+            return splashOk;
+        // writes to a stream wait for the consumer, which must not keep
+        // the renderer from other works
+        SplashBitmap *taken = NULL;
+        if (work->stream != NULL)
+        {
+            taken = splashOut->takeBitmap();
+            pool->release(renderer);
+            renderer = NULL;
+        }
+        SplashBitmap *bitmap = taken != NULL ? taken : splashOut->getBitmap();
+        bool ok = bitmap->getWidth() >= sw && bitmap->getHeight() >= bandRows;
+        if (ok)
         {
-            ((TiffWriter *)writer)->setCompressionString(work->compression);
+            // rows of RGB8, Mono8 and Mono1 bitmaps are in writer format
+            std::vector<unsigned char *> rowPointers(bandRows);
+            for (int i = 0; i < bandRows; i++)
+            {
+                rowPointers[i] = bitmap->getDataPtr() + (size_t)i * bitmap->getRowSize();
+            }
+            ok = writer->writePointers(&rowPointers[0], bandRows);
         }
+        if (renderer != NULL)
+            pool->release(renderer);
+        delete taken;
+        if (!ok)
+            return splashErrGeneric;
+    }
+    return writer->close() ? splashOk : splashErrGeneric;
+}
+
+/**
+     * Displaying page slice to stream work->f
+     */
+void NodePopplerPage::display(RenderWork *work)
+{
+    std::string cachePath;
+    if (work->useDiskCache)
+    {
+        DiskCache *cache = DiskCache::get();
+        cachePath = cache->entryPath(work->parent->getContentHash(), work->renderParams());
+        if (!cachePath.empty() && cache->copyTo(cachePath, work->f))
+            return;
     }
+
+    int bandRows = 0;
     int sx, sy, sw, sh;
-    std::tie(sx, sy, sw, sh) = work->applyScale();
-    if (work->error)
-        return;
-#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 19
-    work->self->pg->displaySlice(splashOut, work->PPI, work->PPI,
-                                 0, false, true,
-                                 sx, sy, sw, sh,
-                                 false, work->self->doc->getCatalog(),
-                                 NULL, NULL, NULL, NULL);
-#else
-    work->self->pg->displaySlice(splashOut, work->PPI, work->PPI,
-                                 0, false, true,
-                                 sx, sy, sw, sh,
-                                 false);
-#endif
+    if (work->w != W_RAW)
+    {
+        std::tie(sx, sy, sw, sh) = work->applyScale(!work->palette);
+        if (work->error)
+            return;
+        bandRows = work->getBandRows(sw, sh);
+        if (work->stream != NULL)
+            work->stream->reserve(work->estimateOutputSize(sw, sh));
+    }
+
+    SplashError e;
+    if (bandRows > 0)
+    {
+        ImgWriter *writer = work->createWriter();
+        e = displayBands(work, writer, sx, sy, sw, sh, bandRows);
+        delete writer;
+        if (work->error)
+            return;
+    }
+    else
+    {
+        RendererPool::Renderer *renderer;
+        SplashOutputDev *splashOut = rasterize(work, &renderer);
+        if (splashOut == NULL)
+            return;
+        RendererPool *pool = work->parent->getRendererPool();
+
+        if (work->w == W_RAW)
+        {
+            // hand the bitmap rows over as is, skipping the encoder
+            SplashBitmap *bitmap = splashOut->takeBitmap();
+            pool->release(renderer);
+            work->width = bitmap->getWidth();
+            work->height = bitmap->getHeight();
+            work->stride = bitmap->getRowSize();
+            work->mstrm_len = (size_t)work->stride * work->height;
+            work->mstrm_buf = (char *)bitmap->takeData();
+            delete bitmap;
+            if (work->pixelFormat == PF_RGBA || work->pixelFormat == PF_BGRA)
+            {
+                for (int y = 0; y < work->height; y++)
+                {
+                    unsigned char *row = (unsigned char *)work->mstrm_buf + (size_t)y * work->stride;
+                    if (work->pixelFormat == PF_RGBA)
+                        xbgrToRGBA(row, work->width);
+                    else
+                        xbgrToBGRA(row, work->width);
+                }
+            }
+            if (work->outputData != NULL)
+            {
+                if (work->copyToOutput(work->mstrm_buf, work->mstrm_len))
+                {
+                    free(work->mstrm_buf);
+                    work->mstrm_buf = NULL;
+                }
+                else if (!work->outputFallback)
+                {
+                    work->setOutputTooSmall(work->mstrm_len);
+                }
+            }
+            return;
+        }
 
-    SplashBitmap *bitmap = splashOut->getBitmap();
+        // release the renderer before encoding, writes to a stream wait
+        // for the consumer
+        SplashBitmap *bitmap = splashOut->takeBitmap();
+        pool->release(renderer);
+        ImgWriter *writer = work->createWriter();
 #if POPPLER_VERSION_MAJOR > 0 || (POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR > 49)
-    SplashError e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI, splashModeRGB8);
+        e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI, work->getColorMode());
 #else
-    SplashError e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI);
+        e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI);
 #endif
-    delete splashOut;
-    if (writer != NULL)
-        delete writer;
+        delete bitmap;
+        if (writer != NULL)
+            delete writer;
+    }
 
     if (e
 #if POPPLER_VERSION_MAJOR == 0 && (POPPLER_VERSION_MINOR < 20 || (POPPLER_VERSION_MINOR == 20 && POPPLER_VERSION_MICRO < 1))
@@ -669,6 +917,13 @@ void NodePopplerPage::display(RenderWork *work)
         work->error = new char[strlen(err) + 1];
         strcpy(work->error, err);
     }
+    else if (!cachePath.empty() && fflush(work->f) == 0)
+    {
+        if (work->dest == DEST_FILE)
+            DiskCache::get()->storeFile(cachePath, work->filename);
+        else if (work->stream != NULL && !work->stream->hasOverflown())
+            DiskCache::get()->store(cachePath, work->stream->getBuffer(), work->stream->getBufferLen());
+    }
 }
 
 /**
@@ -680,30 +935,60 @@ void NodePopplerPage::renderToStream(RenderWork *work)
 {
     if (work->callback == NULL)
     {
-        display(work);
+        if (work->watchSignal(false, NULL))
+            display(work);
     }
     else
     {
-        uv_queue_work(uv_default_loop(), &work->request, AsyncRenderWork, AsyncRenderAfter);
+        if (!work->watchSignal(true, &work->request))
+        {
+            AsyncRenderAfter(&work->request, 0);
+        }
+        else if (!RenderThreadPool::get()->queue(&work->request, AsyncRenderWork, AsyncRenderAfter))
+        {
+            work->setError("Render queue is full");
+            AsyncRenderAfter(&work->request, 0);
+        }
     }
 }
 
-void NodePopplerPage::AsyncRenderWork(uv_work_t *req)
+void NodePopplerPage::AsyncRenderWork(RenderTask *req)
 {
     RenderWork *work = static_cast<RenderWork *>(req->data);
-    display(work);
+    // cancelled while the thread was picking it up
+    if (!work->checkCancelled())
+        display(work);
+    if (work->dest == DEST_STREAM)
+    {
+        // flush on this thread, writes may wait for the consumer
+        work->closeStream();
+    }
 }
 
-void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
+void NodePopplerPage::AsyncRenderAfter(RenderTask *req, int status)
 {
     Nan::HandleScope scope;
     RenderWork *work = static_cast<RenderWork *>(req->data);
 
     work->closeStream();
+    if (work->dest == DEST_STREAM)
+    {
+        work->renderStream->drain();
+        work->renderStream->close();
+        if (work->error == NULL && work->renderStream->isCancelled())
+        {
+            work->setError("Render stream was cancelled");
+        }
+    }
+    work->unwatchSignal();
+    if (status == UV_ECANCELED || work->isCancelled())
+    {
+        work->checkCancelled();
+    }
 
     if (work->error)
     {
-        Local<Value> err = Nan::Error(work->error);
+        Local<Value> err = work->errorValue();
         Local<Value> argv[] = {err};
         Nan::TryCatch try_catch;
         Nan::Call(*work->callback, 1, argv);
@@ -733,16 +1018,25 @@ void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
         }
         case DEST_BUFFER:
         {
-            Local<v8::Object> buffer = Nan::NewBuffer(work->mstrm_len)
-                                           .ToLocalChecked();
+            work->storeInCache();
+            Local<Value> argv[] = {Nan::Null(), work->bufferResult()};
+            Nan::TryCatch try_catch;
+            Nan::AsyncResource res(Nan::New("poppler-simple::render-to-buffer").ToLocalChecked());
+            work->callback->Call(2, argv, &res);
+            if (try_catch.HasCaught())
+            {
+                Nan::FatalException(try_catch);
+            }
+            break;
+        }
+        case DEST_STREAM:
+        {
             Local<v8::Object> out = Nan::New<v8::Object>();
-            memcpy(Buffer::Data(buffer), work->mstrm_buf, work->mstrm_len);
-            out->Set(Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
+            out->Set(Nan::New("type").ToLocalChecked(), Nan::New("stream").ToLocalChecked());
             out->Set(Nan::New("format").ToLocalChecked(), Nan::New(work->format).ToLocalChecked());
-            out->Set(Nan::New("data").ToLocalChecked(), buffer);
             Local<Value> argv[] = {Nan::Null(), out};
             Nan::TryCatch try_catch;
-            Nan::AsyncResource res(Nan::New("poppler-simple::render-to-buffer").ToLocalChecked());
+            Nan::AsyncResource res(Nan::New("poppler-simple::render-to-chunks").ToLocalChecked());
             work->callback->Call(2, argv, &res);
             if (try_catch.HasCaught())
             {
@@ -763,14 +1057,20 @@ void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
      *
      * \param method String \see NodePopplerPage::renderToFile
      * \param PPI Number \see NodePopplerPage::renderToFile
-     * \param options Object \see NodePopplerPage::renderToFile
+     * \param options Object \see NodePopplerPage::renderToFile with additional fields:
+     *   output: Buffer or Object - Buffer to write the result into, or a pool
+     *              with `acquire()` method returning one. Result data is a
+     *              slice of it.
+     *   outputFallback: Boolean - return results not fitting into `output`
+     *              in a new Buffer instead of failing with
+     *              'ERR_OUTPUT_TOO_SMALL' error (default false)
      * \param callback Function \see NodePopplerPage::renderToFile
      */
 NAN_METHOD(NodePopplerPage::renderToBuffer)
 {
     Nan::HandleScope scope;
     NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
-    RenderWork *work = new RenderWork(self, DEST_BUFFER);
+    RenderWork *work = new RenderWork(self->parent, self->pg, DEST_BUFFER);
 
     if (info.Length() < 2 || !info[0]->IsString())
     {
@@ -807,6 +1107,10 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
     if (info.Length() > 2 && info[2]->IsObject())
     {
         work->setWriterOptions(info[2]);
+        if (!work->error)
+        {
+            work->setOutput(info[2]);
+        }
         if (work->error)
         {
             Local<Value> err = Nan::Error(work->error);
@@ -814,6 +1118,29 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
         }
     }
 
+    if (RenderCache::get()->isEnabled())
+    {
+        work->setCacheKey();
+        if (work->loadFromCache())
+        {
+            if (work->callback != NULL)
+            {
+                RenderThreadPool::get()->complete(&work->request, AsyncRenderAfter);
+                return;
+            }
+            if (work->error)
+            {
+                Local<Value> e = work->errorValue();
+                delete work;
+                return Nan::ThrowError(e);
+            }
+            Local<v8::Object> out = work->bufferResult();
+            delete work;
+            info.GetReturnValue().Set(out);
+            return;
+        }
+    }
+
     work->openStream();
     if (work->error)
     {
@@ -821,6 +1148,15 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
         THROW_SYNC_ASYNC_ERR(work, err);
     }
 
+    work->annotated = self->parent->getGeneration() > 0;
+    // annotations are not a part of document content the disk cache is keyed by
+    work->useDiskCache = work->w != W_RAW && !work->annotated && DiskCache::get()->isEnabled();
+    if (work->callback != NULL)
+    {
+        // keep the document alive while rendering on a worker thread
+        work->docHandle.Reset(self->parent->handle());
+    }
+
     self->renderToStream(work);
     if (work->callback != NULL)
     {
@@ -832,21 +1168,14 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
 
         if (work->error)
         {
-            Local<Value> e = Nan::Error(work->error);
+            Local<Value> e = work->errorValue();
             delete work;
             return Nan::ThrowError(e);
         }
         else
         {
-            Local<v8::Object> buffer = Nan::NewBuffer(work->mstrm_len).ToLocalChecked();
-            Local<v8::Object> out = Nan::New<v8::Object>();
-
-            memcpy(Buffer::Data(buffer), work->mstrm_buf, work->mstrm_len);
-
-            out->Set(Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
-            out->Set(Nan::New("format").ToLocalChecked(), info[0]);
-            out->Set(Nan::New("data").ToLocalChecked(), buffer);
-
+            work->storeInCache();
+            Local<v8::Object> out = work->bufferResult();
             delete work;
             info.GetReturnValue().Set(out);
         }
@@ -854,24 +1183,173 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
 }
 
 /**
-     * Renders page to a file
+     * Renders page to a sequence of chunks
+     *
+     * Encoder output is passed to Javascript while the page is being
+     * encoded, rather than as one buffer at the end.
      *
      * Javascript function
      *
-     * \param path String. Path to output file.
-     * \param method String with value 'png', 'jpeg' or 'tiff'. Image compression method.
-     * \param PPI Number. Pixel per inch value.
-     * \param options Object with optional fields:
-     *   quality: Integer - defines jpeg quality value (0 - 100) if
-     *              image compression method 'jpeg' (default 100)
+     * \param method String with value 'png' or 'jpeg'
+     * \param PPI Number \see NodePopplerPage::renderToFile
+     * \param options Object \see NodePopplerPage::renderToFile with additional field:
+     *   highWaterMark: Integer - bytes queued before the encoder waits
+     *              for a paused consumer (default 65536)
+     * \param onChunk Function. Called with every chunk Buffer. If it returns
+     *              false, chunks are not delivered until `resume()` is
+     *              called on the returned object.
+     * \param callback Function. Called once all chunks are delivered
+     *
+     * \return Object with `resume()` and `cancel()` methods
+     */
+NAN_METHOD(NodePopplerPage::renderToChunks)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    if (info.Length() < 4 || !info[0]->IsString() ||
+        !info[info.Length() - 2]->IsFunction() || !info[info.Length() - 1]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (method: String, PPI: Number[, options: Object], onChunk: Function, callback: Function)");
+    }
+
+    RenderWork *work = new RenderWork(self->parent, self->pg, DEST_STREAM);
+    work->callback = new Nan::Callback(info[info.Length() - 1].As<v8::Function>());
+    Local<v8::Function> onChunk = info[info.Length() - 2].As<v8::Function>();
+    size_t highWaterMark = 65536;
+
+    if (self->isDocClosed())
+    {
+        Local<Value> err = Nan::Error("Document closed. You must delete this page");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->setWriter(info[0]);
+    if (work->error)
+    {
+        Local<Value> err = Nan::Error(work->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    if (work->w == W_TIFF || work->w == W_RAW)
+    {
+        Local<Value> err = Nan::Error("Only 'png' and 'jpeg' formats could be rendered to chunks");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->setPPI(info[1]);
+    if (work->error)
+    {
+        Local<Value> err = Nan::Error(work->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    if (info.Length() > 4 && info[2]->IsObject())
+    {
+        work->setWriterOptions(info[2]);
+        if (work->error)
+        {
+            Local<Value> err = Nan::Error(work->error);
+            THROW_SYNC_ASYNC_ERR(work, err);
+        }
+        Local<v8::Object> options = To<v8::Object>(info[2]).ToLocalChecked();
+        Local<String> hk = Nan::New("highWaterMark").ToLocalChecked();
+        if (options->Has(hk))
+        {
+            Local<Value> hv = options->Get(hk);
+            if (!hv->IsUint32())
+            {
+                Local<Value> err = Nan::Error("'highWaterMark' option value must be a non-negative integer");
+                THROW_SYNC_ASYNC_ERR(work, err);
+            }
+            highWaterMark = To<uint32_t>(hv).FromJust();
+        }
+    }
+
+    work->renderStream = RenderStream::NewInstance(new Nan::Callback(onChunk), highWaterMark);
+    Local<v8::Object> control = work->renderStream->handle();
+    work->streamHandle.Reset(control);
+
+    work->openStream();
+    if (work->error)
+    {
+        Local<Value> err = Nan::Error(work->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    // disk cache keys don't cover added annotations
+    work->annotated = self->parent->getGeneration() > 0;
+    // keep the document alive while rendering on a worker thread
+    work->docHandle.Reset(self->parent->handle());
+
+    self->renderToStream(work);
+    info.GetReturnValue().Set(control);
+}
+
+/**
+     * Renders page to a file
+     *
+     * Javascript function
+     *
+     * \param path String. Path to output file.
+     * \param method String with value 'png', 'jpeg' or 'tiff'. Image compression method.
+     * \param PPI Number. Pixel per inch value.
+     * \param options Object with optional fields:
+     *   quality: Integer - defines jpeg quality value (0 - 100) if
+     *              image compression method 'jpeg' (default 100)
      *   compression: String - defines tiff compression string if image compression method
      *              is 'tiff' (default NULL).
      *   progressive: Boolean - defines progressive compression for JPEG (default false)
+     *   subsampling: String - JPEG chroma subsampling, '4:2:0', '4:2:2' or
+     *              '4:4:4' (default '4:2:0')
+     *   dctMethod: String - JPEG DCT, 'accurate', 'fast' or 'float'
+     *              (default 'accurate')
+     *   optimize: Boolean - compute optimal JPEG Huffman tables, smaller
+     *              output for an extra pass (default false)
+     *   restartInterval: Integer - JPEG restart marker every N MCU rows,
+     *              0 - 65535 (default 0, no markers)
+     *   compressionLevel: Integer - PNG zlib level 0 - 9 (default zlib's 6)
+     *   compressionStrategy: String - PNG zlib strategy, 'default',
+     *              'filtered', 'huffman', 'rle' or 'fixed' (default libpng's choice)
+     *   filter: String - PNG row filter, 'none', 'sub', 'up', 'average',
+     *              'paeth' or 'all' (default libpng's choice)
+     *   palette: Boolean - write 'rgb' PNG as indexed color with at most
+     *              256 colors, exact for pages with few colors (default false).
+     *              Palette images are never banded.
+     *   bandHeight: Integer - rasterize and encode the image in bands of
+     *              this many rows to bound memory use. Images over 32M
+     *              pixels are banded automatically, banded images are not
+     *              limited to 100M pixels.
+     *   pixelFormat: String - pixel layout for 'raw' method of \see NodePopplerPage::renderToBuffer,
+     *              one of 'rgb', 'rgba', 'bgra' or 'gray' (default 'rgb')
+     *   colorMode: String - 'rgb', 'gray' or 'mono' (default 'rgb'). The page
+     *              is rendered and encoded in this mode. 'mono' is not
+     *              supported by 'jpeg', mono 'tiff' defaults to 'ccittfax4'
+     *              compression.
      *   slice: Object - Slice definition in format of object with fields
      *            x: for relative x coordinate of bottom left corner
      *            y: for relative y coordinate of bottom left corner
      *            w: for relative slice width
      *            h: for relative slice height
+     *   signal: AbortSignal - aborts the render. Queued renders are
+     *              dropped, running ones stop drawing. The callback gets
+     *              an error with code 'ERR_RENDER_CANCELLED'.
+     *   maxRenderMs: Number - stops drawing after this many milliseconds
+     *              with 'ERR_RENDER_TIME_LIMIT' error (default no limit)
+     *   maxOperations: Integer - stops drawing after about this many
+     *              content stream operations with 'ERR_RENDER_OPERATION_LIMIT'
+     *              error (default no limit)
+     *   preset: String - 'fast' turns off vector and text anti-aliasing
+     *              and turns on draft mode for cheaper rasterization of
+     *              previews and thumbnails. Options below override the preset.
+     *   vectorAntialias: Boolean - anti-alias paths (default true)
+     *   textAntialias: Boolean - anti-alias glyphs (default true)
+     *   thinLineMode: String - 'default', 'solid' or 'shape', drawing of
+     *              lines thinner than a pixel (default 'default')
+     *   hinting: String - FreeType hinting, 'none', 'slight' or 'full'
+     *              (default 'none')
+     *   draft: Boolean - decode JPEG images drawn much smaller than
+     *              their size at 1/2, 1/4 or 1/8 scale (default false)
      * \param callback Function. If exists, then called asynchronously
      *
      * \return Node::Buffer Buffer with rendered image data.
@@ -880,7 +1358,7 @@ NAN_METHOD(NodePopplerPage::renderToFile)
 {
     Nan::HandleScope scope;
     NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
-    RenderWork *work = new RenderWork(self, DEST_FILE);
+    RenderWork *work = new RenderWork(self->parent, self->pg, DEST_FILE);
 
     if (info.Length() < 3)
     {
@@ -915,6 +1393,12 @@ NAN_METHOD(NodePopplerPage::renderToFile)
         THROW_SYNC_ASYNC_ERR(work, err);
     }
 
+    if (work->w == W_RAW)
+    {
+        Local<Value> err = Nan::Error("'raw' format could be rendered only to a buffer");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
     work->setPPI(info[2]);
     if (work->error)
     {
@@ -939,6 +1423,15 @@ NAN_METHOD(NodePopplerPage::renderToFile)
         THROW_SYNC_ASYNC_ERR(work, err);
     }
 
+    work->annotated = self->parent->getGeneration() > 0;
+    // annotations are not a part of document content the disk cache is keyed by
+    work->useDiskCache = work->w != W_RAW && !work->annotated && DiskCache::get()->isEnabled();
+    if (work->callback != NULL)
+    {
+        // keep the document alive while rendering on a worker thread
+        work->docHandle.Reset(self->parent->handle());
+    }
+
     self->renderToStream(work);
     if (work->callback != NULL)
     {
@@ -949,7 +1442,7 @@ NAN_METHOD(NodePopplerPage::renderToFile)
         work->closeStream();
         if (work->error)
         {
-            Local<Value> e = Nan::Error(work->error);
+            Local<Value> e = work->errorValue();
             unlink(work->filename);
             delete work;
             return Nan::ThrowError(e);
@@ -965,6 +1458,230 @@ NAN_METHOD(NodePopplerPage::renderToFile)
     }
 }
 
+/**
+     * Renders page as tiles of one or several zoom levels
+     *
+     * Every level is rasterized once and then cut into tiles.
+     *
+     * Javascript function
+     *
+     * \param method String \see NodePopplerPage::renderToBuffer
+     * \param options Object \see NodePopplerPage::renderToFile with additional fields:
+     *   levels: Array - PPI of every zoom level (required)
+     *   tileSize: Integer - tile width and height in pixels (default 256)
+     *   overlap: Integer - pixels every tile extends over its neighbours
+     *              (default 0)
+     *   path: String - if set, tiles are written to files
+     *              `<path>/<level>/<col>_<row>.<method>` instead of buffers
+     * \param callback Function. If exists, then called asynchronously
+     *
+     * \return Array of tiles with fields level, col, row, x, y, width,
+     *          height, format and `data` Buffer or `path`
+     */
+NAN_METHOD(NodePopplerPage::renderTiles)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+    TileRender *work = new TileRender(new RenderWork(self->parent, self->pg, DEST_BUFFER));
+
+    if (info.Length() < 2 || !info[0]->IsString() || !info[1]->IsObject())
+    {
+        delete work;
+        return Nan::ThrowError("Arguments: (method: String, options: Object[, callback: Function])");
+    }
+
+    if (info[info.Length() - 1]->IsFunction())
+    {
+        Local<v8::Function> callbackHandle = info[info.Length() - 1].As<v8::Function>();
+        work->callback = new Nan::Callback(callbackHandle);
+    }
+
+    if (self->isDocClosed())
+    {
+        Local<Value> err = Nan::Error("Document closed. You must delete this page");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->settings->setWriter(info[0]);
+    if (work->settings->error)
+    {
+        Local<Value> err = Nan::Error(work->settings->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->settings->setWriterOptions(info[1]);
+    if (work->settings->error)
+    {
+        Local<Value> err = Nan::Error(work->settings->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->setOptions(info[1]);
+    if (work->settings->error)
+    {
+        Local<Value> err = Nan::Error(work->settings->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    // disk cache keys don't cover added annotations
+    work->settings->annotated = self->parent->getGeneration() > 0;
+    if (work->callback != NULL)
+    {
+        // keep the document alive while rendering on a worker thread
+        work->settings->docHandle.Reset(self->parent->handle());
+    }
+
+    work->start();
+    if (work->callback != NULL)
+    {
+        return;
+    }
+    if (work->settings->error)
+    {
+        Local<Value> e = work->settings->errorValue();
+        delete work;
+        return Nan::ThrowError(e);
+    }
+    Local<v8::Array> out = work->result();
+    delete work;
+    info.GetReturnValue().Set(out);
+}
+
+/**
+     * Renders page to several buffers of different resolution
+     *
+     * The page is rasterized once at the highest requested resolution,
+     * smaller variants are downscaled from that bitmap.
+     *
+     * Javascript function
+     *
+     * \param variants Array of Objects \see NodePopplerPage::renderToFile options
+     *              with additional fields:
+     *   format: String - 'png', 'jpeg', 'tiff' or 'raw'
+     *   ppi: Number - pixel per inch value
+     * \param options Object with optional fields:
+     *   slice: Object - \see NodePopplerPage::renderToFile, shared by all variants
+     *   signal: AbortSignal - \see NodePopplerPage::renderToFile
+     *   maxRenderMs: Number - \see NodePopplerPage::renderToFile
+     *   maxOperations: Integer - \see NodePopplerPage::renderToFile
+     *   preset, vectorAntialias, textAntialias, thinLineMode, hinting, draft -
+     *              \see NodePopplerPage::renderToFile
+     * \param callback Function. If exists, then called asynchronously
+     *
+     * \return Array of \see NodePopplerPage::renderToBuffer results extended
+     *          with `PPI` field, in order of variants
+     */
+NAN_METHOD(NodePopplerPage::renderVariants)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+    VariantRender *work = new VariantRender(new RenderWork(self->parent, self->pg, DEST_BUFFER));
+
+    if (info.Length() < 1 || !info[0]->IsArray() || Local<v8::Array>::Cast(info[0])->Length() == 0)
+    {
+        delete work;
+        return Nan::ThrowError("Arguments: (variants: Array[, options: Object, callback: Function])");
+    }
+
+    if (info[info.Length() - 1]->IsFunction())
+    {
+        Local<v8::Function> callbackHandle = info[info.Length() - 1].As<v8::Function>();
+        work->callback = new Nan::Callback(callbackHandle);
+    }
+
+    if (self->isDocClosed())
+    {
+        Local<Value> err = Nan::Error("Document closed. You must delete this page");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    if (info.Length() > 1 && info[1]->IsObject() && !info[1]->IsFunction())
+    {
+        Local<v8::Object> options = To<v8::Object>(info[1]).ToLocalChecked();
+        Local<String> sk = Nan::New("slice").ToLocalChecked();
+        Local<String> ak = Nan::New("signal").ToLocalChecked();
+        if (options->Has(sk))
+        {
+            work->master->setSlice(options->Get(sk));
+        }
+        if (options->Has(ak) && !work->master->error)
+        {
+            work->master->setSignal(options->Get(ak));
+        }
+        if (!work->master->error)
+        {
+            work->master->setLimits(options);
+        }
+        if (!work->master->error)
+        {
+            work->master->setRasterOptions(options);
+        }
+        if (work->master->error)
+        {
+            Local<Value> err = Nan::Error(work->master->error);
+            THROW_SYNC_ASYNC_ERR(work, err);
+        }
+    }
+
+    Local<v8::Array> variants = Local<v8::Array>::Cast(info[0]);
+    Local<String> fk = Nan::New("format").ToLocalChecked();
+    Local<String> pk = Nan::New("ppi").ToLocalChecked();
+    for (uint32_t i = 0; i < variants->Length(); i++)
+    {
+        Local<Value> v = variants->Get(i);
+        if (!v->IsObject())
+        {
+            Local<Value> err = Nan::Error("Variant must be an instance of Object");
+            THROW_SYNC_ASYNC_ERR(work, err);
+        }
+        Local<v8::Object> vo = To<v8::Object>(v).ToLocalChecked();
+        RenderWork *variant = new RenderWork(self->parent, self->pg, DEST_BUFFER);
+        work->variants.push_back(variant);
+        variant->setWriter(vo->Get(fk));
+        if (!variant->error)
+        {
+            variant->setPPI(vo->Get(pk));
+        }
+        if (!variant->error)
+        {
+            variant->setWriterOptions(vo);
+        }
+        if (!variant->error && variant->colorMode == CM_MONO)
+        {
+            // variants are downscaled from a shared color bitmap
+            variant->setError("'mono' color mode is not supported by renderVariants");
+        }
+        if (variant->error)
+        {
+            Local<Value> err = Nan::Error(variant->error);
+            THROW_SYNC_ASYNC_ERR(work, err);
+        }
+    }
+
+    // disk cache keys don't cover added annotations
+    work->master->annotated = self->parent->getGeneration() > 0;
+    if (work->callback != NULL)
+    {
+        // keep the document alive while rendering on a worker thread
+        work->master->docHandle.Reset(self->parent->handle());
+    }
+
+    work->start();
+    if (work->callback != NULL)
+    {
+        return;
+    }
+    if (work->master->error)
+    {
+        Local<Value> e = work->master->errorValue();
+        delete work;
+        return Nan::ThrowError(e);
+    }
+    Local<v8::Array> out = work->result();
+    delete work;
+    info.GetReturnValue().Set(out);
+}
+
 void NodePopplerPage::RenderWork::setWriter(const Local<Value> method)
 {
     Nan::HandleScope scope;
@@ -984,6 +1701,10 @@ void NodePopplerPage::RenderWork::setWriter(const Local<Value> method)
         {
             this->w = W_TIFF;
         }
+        else if (strncmp(*m, "raw", 3) == 0)
+        {
+            this->w = W_RAW;
+        }
         else
         {
             e = (char *)"Unsupported compression method";
@@ -1011,7 +1732,19 @@ void NodePopplerPage::RenderWork::setWriterOptions(const Local<Value> optsVal)
     Local<String> ck = Nan::New("compression").ToLocalChecked();
     Local<String> qk = Nan::New("quality").ToLocalChecked();
     Local<String> pk = Nan::New("progressive").ToLocalChecked();
+    Local<String> ssk = Nan::New("subsampling").ToLocalChecked();
+    Local<String> dck = Nan::New("dctMethod").ToLocalChecked();
+    Local<String> ok = Nan::New("optimize").ToLocalChecked();
+    Local<String> rik = Nan::New("restartInterval").ToLocalChecked();
+    Local<String> lk = Nan::New("compressionLevel").ToLocalChecked();
+    Local<String> stk = Nan::New("compressionStrategy").ToLocalChecked();
+    Local<String> flk = Nan::New("filter").ToLocalChecked();
+    Local<String> plk = Nan::New("palette").ToLocalChecked();
+    Local<String> bhk = Nan::New("bandHeight").ToLocalChecked();
     Local<String> sk = Nan::New("slice").ToLocalChecked();
+    Local<String> fk = Nan::New("pixelFormat").ToLocalChecked();
+    Local<String> ak = Nan::New("signal").ToLocalChecked();
+    Local<String> mk = Nan::New("colorMode").ToLocalChecked();
     Local<v8::Object> options;
     char *e = NULL;
 
@@ -1039,6 +1772,10 @@ void NodePopplerPage::RenderWork::setWriterOptions(const Local<Value> optsVal)
                         this->compression = new char[cmp_utf8_len + 1];
                         memcpy(this->compression, *cmp_utf8, cmp_utf8_len);
                         this->compression[cmp_utf8_len] = 0;
+                        if (!TiffStreamWriter::isCompressionSupported(this->compression))
+                        {
+                            e = (char *)"Unsupported 'compression' option value";
+                        }
                     }
                     else
                     {
@@ -1082,10 +1819,301 @@ void NodePopplerPage::RenderWork::setWriterOptions(const Local<Value> optsVal)
                     e = (char *)"'progressive' option value must be a boolean value";
                 }
             }
+            if (options->Has(ssk))
+            {
+                Local<Value> sv = options->Get(ssk);
+                if (sv->IsString())
+                {
+                    Nan::Utf8String ss(sv);
+                    if (strcmp(*ss, "4:2:0") == 0)
+                    {
+                        this->subsampling = JpegStreamWriter::SUBSAMPLING_420;
+                    }
+                    else if (strcmp(*ss, "4:2:2") == 0)
+                    {
+                        this->subsampling = JpegStreamWriter::SUBSAMPLING_422;
+                    }
+                    else if (strcmp(*ss, "4:4:4") == 0)
+                    {
+                        this->subsampling = JpegStreamWriter::SUBSAMPLING_444;
+                    }
+                    else
+                    {
+                        e = (char *)"Unsupported 'subsampling' option value";
+                    }
+                }
+                else
+                {
+                    e = (char *)"'subsampling' option must be an instance of string";
+                }
+            }
+            if (options->Has(dck))
+            {
+                Local<Value> dv = options->Get(dck);
+                if (dv->IsString())
+                {
+                    Nan::Utf8String dm(dv);
+                    if (strcmp(*dm, "accurate") == 0)
+                    {
+                        this->dctMethod = JpegStreamWriter::DCT_ACCURATE;
+                    }
+                    else if (strcmp(*dm, "fast") == 0)
+                    {
+                        this->dctMethod = JpegStreamWriter::DCT_FAST;
+                    }
+                    else if (strcmp(*dm, "float") == 0)
+                    {
+                        this->dctMethod = JpegStreamWriter::DCT_FLOAT;
+                    }
+                    else
+                    {
+                        e = (char *)"Unsupported 'dctMethod' option value";
+                    }
+                }
+                else
+                {
+                    e = (char *)"'dctMethod' option must be an instance of string";
+                }
+            }
+            if (options->Has(ok))
+            {
+                Local<Value> ov = options->Get(ok);
+                if (ov->IsBoolean())
+                {
+                    this->optimize = To<bool>(ov).FromJust();
+                }
+                else
+                {
+                    e = (char *)"'optimize' option value must be a boolean value";
+                }
+            }
+            if (options->Has(rik))
+            {
+                Local<Value> rv = options->Get(rik);
+                if (rv->IsUint32() && To<uint32_t>(rv).FromJust() <= 65535)
+                {
+                    this->restartInterval = To<uint32_t>(rv).FromJust();
+                }
+                else
+                {
+                    e = (char *)"'restartInterval' option value must be 0 - 65535 interval integer";
+                }
+            }
         }
         break;
         case W_PNG:
-            break;
+        {
+            if (options->Has(lk))
+            {
+                Local<Value> lv = options->Get(lk);
+                if (lv->IsUint32() && To<uint32_t>(lv).FromJust() <= 9)
+                {
+                    this->pngLevel = To<uint32_t>(lv).FromJust();
+                }
+                else
+                {
+                    e = (char *)"'compressionLevel' option value must be 0 - 9 interval integer";
+                }
+            }
+            if (options->Has(stk))
+            {
+                Local<Value> sv = options->Get(stk);
+                if (sv->IsString())
+                {
+                    Nan::Utf8String st(sv);
+                    if (strcmp(*st, "default") == 0)
+                    {
+                        this->pngStrategy = PngStreamWriter::STRATEGY_DEFAULT;
+                    }
+                    else if (strcmp(*st, "filtered") == 0)
+                    {
+                        this->pngStrategy = PngStreamWriter::STRATEGY_FILTERED;
+                    }
+                    else if (strcmp(*st, "huffman") == 0)
+                    {
+                        this->pngStrategy = PngStreamWriter::STRATEGY_HUFFMAN;
+                    }
+                    else if (strcmp(*st, "rle") == 0)
+                    {
+                        this->pngStrategy = PngStreamWriter::STRATEGY_RLE;
+                    }
+                    else if (strcmp(*st, "fixed") == 0)
+                    {
+                        this->pngStrategy = PngStreamWriter::STRATEGY_FIXED;
+                    }
+                    else
+                    {
+                        e = (char *)"Unsupported 'compressionStrategy' option value";
+                    }
+                }
+                else
+                {
+                    e = (char *)"'compressionStrategy' option must be an instance of string";
+                }
+            }
+            if (options->Has(flk))
+            {
+                Local<Value> fv = options->Get(flk);
+                if (fv->IsString())
+                {
+                    Nan::Utf8String fl(fv);
+                    if (strcmp(*fl, "none") == 0)
+                    {
+                        this->pngFilter = PngStreamWriter::FILTER_NONE;
+                    }
+                    else if (strcmp(*fl, "sub") == 0)
+                    {
+                        this->pngFilter = PngStreamWriter::FILTER_SUB;
+                    }
+                    else if (strcmp(*fl, "up") == 0)
+                    {
+                        this->pngFilter = PngStreamWriter::FILTER_UP;
+                    }
+                    else if (strcmp(*fl, "average") == 0)
+                    {
+                        this->pngFilter = PngStreamWriter::FILTER_AVERAGE;
+                    }
+                    else if (strcmp(*fl, "paeth") == 0)
+                    {
+                        this->pngFilter = PngStreamWriter::FILTER_PAETH;
+                    }
+                    else if (strcmp(*fl, "all") == 0)
+                    {
+                        this->pngFilter = PngStreamWriter::FILTER_ALL;
+                    }
+                    else
+                    {
+                        e = (char *)"Unsupported 'filter' option value";
+                    }
+                }
+                else
+                {
+                    e = (char *)"'filter' option must be an instance of string";
+                }
+            }
+            if (options->Has(plk))
+            {
+                Local<Value> pv = options->Get(plk);
+                if (pv->IsBoolean())
+                {
+                    this->palette = To<bool>(pv).FromJust();
+                }
+                else
+                {
+                    e = (char *)"'palette' option value must be a boolean value";
+                }
+            }
+        }
+        break;
+        case W_RAW:
+        {
+            if (options->Has(fk))
+            {
+                Local<Value> fv = options->Get(fk);
+                if (fv->IsString())
+                {
+                    Nan::Utf8String pf(fv);
+                    if (strcmp(*pf, "rgb") == 0)
+                    {
+                        this->pixelFormat = PF_RGB;
+                    }
+                    else if (strcmp(*pf, "rgba") == 0)
+                    {
+                        this->pixelFormat = PF_RGBA;
+                    }
+                    else if (strcmp(*pf, "bgra") == 0)
+                    {
+                        this->pixelFormat = PF_BGRA;
+                    }
+                    else if (strcmp(*pf, "gray") == 0)
+                    {
+                        this->pixelFormat = PF_GRAY;
+                    }
+                    else
+                    {
+                        e = (char *)"Unsupported 'pixelFormat' option value";
+                    }
+                }
+                else
+                {
+                    e = (char *)"'pixelFormat' option must be an instance of string";
+                }
+            }
+        }
+        break;
+        }
+        if (options->Has(mk) && !e)
+        {
+            Local<Value> mv = options->Get(mk);
+            if (mv->IsString())
+            {
+                Nan::Utf8String cm(mv);
+                if (strcmp(*cm, "rgb") == 0)
+                {
+                    this->colorMode = CM_RGB;
+                }
+                else if (strcmp(*cm, "gray") == 0)
+                {
+                    this->colorMode = CM_GRAY;
+                }
+                else if (strcmp(*cm, "mono") == 0)
+                {
+                    this->colorMode = CM_MONO;
+                }
+                else
+                {
+                    e = (char *)"Unsupported 'colorMode' option value";
+                }
+            }
+            else
+            {
+                e = (char *)"'colorMode' option must be an instance of string";
+            }
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 50
+            if (!e && this->colorMode != CM_RGB)
+            {
+                // writeImgFile could only write RGB
+                e = (char *)"'colorMode' option requires poppler 0.50 or newer";
+            }
+#endif
+            if (!e && this->colorMode != CM_RGB && this->w == W_RAW)
+            {
+                e = (char *)"'colorMode' option is not supported by 'raw' method, use 'pixelFormat'";
+            }
+            if (!e && this->colorMode == CM_MONO && this->w == W_JPEG)
+            {
+                e = (char *)"'mono' color mode is not supported by 'jpeg' method";
+            }
+            if (!e && this->colorMode != CM_RGB && this->palette)
+            {
+                e = (char *)"'palette' option requires 'rgb' color mode";
+            }
+        }
+        if (options->Has(bhk) && !e)
+        {
+            Local<Value> bv = options->Get(bhk);
+            if (!bv->IsUint32() || To<uint32_t>(bv).FromJust() == 0 || To<uint32_t>(bv).FromJust() > INT_MAX)
+            {
+                e = (char *)"'bandHeight' option value must be a positive integer";
+            }
+            else if (this->w == W_RAW)
+            {
+                e = (char *)"'bandHeight' option is not supported by 'raw' method";
+            }
+            else if (this->palette)
+            {
+                // the palette is built from the whole image
+                e = (char *)"'bandHeight' option is not supported with 'palette' option";
+            }
+            else
+            {
+                this->bandHeight = To<uint32_t>(bv).FromJust();
+            }
+        }
+        if (!e && this->w == W_TIFF && this->compression != NULL &&
+            strncmp(this->compression, "ccitt", 5) == 0 && this->colorMode != CM_MONO)
+        {
+            e = (char *)"CCITT compression requires 'mono' color mode";
         }
         if (options->Has(sk))
         {
@@ -1101,6 +2129,18 @@ void NodePopplerPage::RenderWork::setWriterOptions(const Local<Value> optsVal)
             slice->Set(Nan::New("h").ToLocalChecked(), Nan::New<Number>(1));
             this->setSlice(slice);
         }
+        if (options->Has(ak) && !e && !this->error)
+        {
+            this->setSignal(options->Get(ak));
+        }
+        if (!e && !this->error)
+        {
+            this->setLimits(options);
+        }
+        if (!e && !this->error)
+        {
+            this->setRasterOptions(options);
+        }
     }
     if (e)
     {
@@ -1168,19 +2208,32 @@ void NodePopplerPage::RenderWork::setPath(const Local<Value> path)
     }
 }
 
-std::tuple<int, int, int, int> NodePopplerPage::RenderWork::applyScale()
+// largest image rendered to one bitmap
+static const unsigned long MAX_BITMAP_PIXELS = 100000000L;
+// encoded images above this size are rendered in bands of this size
+static const unsigned long BAND_PIXELS = 1L << 25;
+// banded images are limited by side only
+static const double MAX_BANDED_SIDE = 1 << 20;
+
+/**
+     * Computes page slice rectangle in device pixels. Images rendered in
+     * bands (\see NodePopplerPage::displayBands) may exceed the single
+     * bitmap size limit.
+     */
+std::tuple<int, int, int, int> NodePopplerPage::RenderWork::applyScale(bool banded)
 {
     char *e = NULL;
     double scale, scaledWidth, scaledHeight;
     int scaled_x, scaled_y, scaled_w, scaled_h;
     scale = PPI / 72.0;
-    scaledWidth = self->getWidth() * scale;
-    scaledHeight = self->getHeight() * scale;
+    scaledWidth = getPageWidth() * scale;
+    scaledHeight = getPageHeight() * scale;
     scaled_w = scaledWidth * slice_w;
     scaled_h = scaledHeight * slice_h;
     scaled_x = scaledWidth * slice_x;
     scaled_y = scaledHeight - scaledHeight * slice_y - scaledHeight * slice_h;
-    if ((unsigned long)(scaled_w * scaled_h) > 100000000L)
+    if (scaledWidth * slice_w > MAX_BANDED_SIDE || scaledHeight * slice_h > MAX_BANDED_SIDE ||
+        (!banded && (unsigned long)scaled_w * scaled_h > MAX_BITMAP_PIXELS))
     {
         e = (char *)"Result image is too big";
     }
@@ -1192,6 +2245,556 @@ std::tuple<int, int, int, int> NodePopplerPage::RenderWork::applyScale()
     return std::make_tuple(scaled_x, scaled_y, scaled_w, scaled_h);
 }
 
+/**
+     * Number of rows per band for an encoded image of the given size,
+     * 0 to render it to a single bitmap
+     */
+int NodePopplerPage::RenderWork::getBandRows(int width, int height)
+{
+    // the palette writer buffers the whole image anyway
+    if (palette)
+        return 0;
+    if (bandHeight > 0)
+        return bandHeight < height ? bandHeight : 0;
+    if ((unsigned long)width * height <= BAND_PIXELS)
+        return 0;
+    int rows = (int)(BAND_PIXELS / (width > 0 ? width : 1));
+    return rows > 0 ? rows : 1;
+}
+
+// largest estimate used to presize an output stream
+static const size_t MAX_OUTPUT_ESTIMATE = 64 * 1024 * 1024;
+
+/**
+     * Rough encoded size of an image of the given size, used to presize
+     * output streams. Underestimates cost extra stream segments, while
+     * overestimated memory is given back before the output is handed over.
+     */
+size_t NodePopplerPage::RenderWork::estimateOutputSize(int width, int height)
+{
+    size_t raw;
+    if (colorMode == CM_MONO)
+        raw = (size_t)(width + 7) / 8 * height;
+    else if (colorMode == CM_GRAY || palette)
+        raw = (size_t)width * height;
+    else
+        raw = (size_t)width * height * 3;
+    size_t estimate;
+    switch (w)
+    {
+    case W_JPEG:
+        estimate = raw / (quality > 90 ? 4 : 8);
+        break;
+    case W_PNG:
+        estimate = raw / 4;
+        break;
+    case W_TIFF:
+        estimate = compression == NULL || strcmp(compression, "none") == 0 ? raw : raw / 2;
+        break;
+    default:
+        estimate = raw;
+        break;
+    }
+    // headers and metadata
+    estimate += 4096;
+    return estimate < MAX_OUTPUT_ESTIMATE ? estimate : MAX_OUTPUT_ESTIMATE;
+}
+
+void NodePopplerPage::RenderWork::setError(const char *e, const char *code)
+{
+    if (this->error)
+        delete[] this->error;
+    this->error = new char[strlen(e) + 1];
+    strcpy(this->error, e);
+    this->errorCode = code;
+}
+
+/**
+     * Error object for work->error, with `code` property if it has one
+     */
+Local<Value> NodePopplerPage::RenderWork::errorValue()
+{
+    Local<Value> err = Nan::Error(this->error);
+    if (this->errorCode)
+    {
+        To<v8::Object>(err).ToLocalChecked()->Set(Nan::New("code").ToLocalChecked(),
+                                                   Nan::New(this->errorCode).ToLocalChecked());
+    }
+    return err;
+}
+
+/**
+     * Sets error of cancelled work. Returns true if the work is cancelled.
+     */
+bool NodePopplerPage::RenderWork::checkCancelled()
+{
+    if (!this->isCancelled())
+        return false;
+    this->setError("Render was cancelled", "ERR_RENDER_CANCELLED");
+    return true;
+}
+
+/**
+     * Reads `maxRenderMs` and `maxOperations` render budget options
+     */
+void NodePopplerPage::RenderWork::setLimits(const Local<v8::Object> options)
+{
+    Nan::HandleScope scope;
+    Local<String> tk = Nan::New("maxRenderMs").ToLocalChecked();
+    Local<String> ok = Nan::New("maxOperations").ToLocalChecked();
+    if (options->Has(tk))
+    {
+        Local<Value> tv = options->Get(tk);
+        if (!tv->IsNumber() || !(To<double>(tv).FromJust() > 0))
+        {
+            this->setError("'maxRenderMs' option value must be a positive number");
+            return;
+        }
+        this->maxRenderMs = To<double>(tv).FromJust();
+    }
+    if (options->Has(ok))
+    {
+        Local<Value> ov = options->Get(ok);
+        if (!ov->IsUint32() || To<uint32_t>(ov).FromJust() == 0)
+        {
+            this->setError("'maxOperations' option value must be a positive integer");
+            return;
+        }
+        this->maxOperations = To<uint32_t>(ov).FromJust();
+    }
+}
+
+/**
+     * Checks render budgets from the abort check of a render thread
+     */
+bool NodePopplerPage::RenderWork::isOverLimit()
+{
+    this->abortChecks++;
+    if (this->maxOperations > 0 && this->abortChecks * OPERATIONS_PER_ABORT_CHECK > this->maxOperations)
+    {
+        this->limit = LIMIT_OPERATIONS;
+        return true;
+    }
+    if (this->maxRenderMs > 0 && (uv_hrtime() - this->renderStart) / 1e6 > this->maxRenderMs)
+    {
+        this->limit = LIMIT_TIME;
+        return true;
+    }
+    return false;
+}
+
+/**
+     * Sets error of work stopped by a budget. Returns true if it was.
+     */
+bool NodePopplerPage::RenderWork::checkLimits()
+{
+    switch (this->limit)
+    {
+    case LIMIT_TIME:
+        this->setError("Render took longer than 'maxRenderMs'", "ERR_RENDER_TIME_LIMIT");
+        return true;
+    case LIMIT_OPERATIONS:
+        this->setError("Page has more operations than 'maxOperations'", "ERR_RENDER_OPERATION_LIMIT");
+        return true;
+    default:
+        return false;
+    }
+}
+
+void NodePopplerPage::RenderWork::setSignal(const Local<Value> signalVal)
+{
+    Nan::HandleScope scope;
+    if (signalVal->IsUndefined() || signalVal->IsNull())
+        return;
+    Local<String> ak = Nan::New("aborted").ToLocalChecked();
+    Local<String> lk = Nan::New("addEventListener").ToLocalChecked();
+    if (!signalVal->IsObject() ||
+        !To<v8::Object>(signalVal).ToLocalChecked()->Has(ak) ||
+        !To<v8::Object>(signalVal).ToLocalChecked()->Get(lk)->IsFunction())
+    {
+        this->setError("'signal' option must be an instance of AbortSignal");
+        return;
+    }
+    this->signal.Reset(To<v8::Object>(signalVal).ToLocalChecked());
+}
+
+/**
+     * Subscribes to the abort signal of the work, if any, for the render
+     * to be stopped and `task`, if not NULL, taken off the render queue.
+     * Synchronous renders could only be aborted before they start.
+     *
+     * Returns false with work->error set if the signal is already aborted.
+     */
+bool NodePopplerPage::RenderWork::watchSignal(bool async, RenderTask *task)
+{
+    Nan::HandleScope scope;
+    if (this->signal.IsEmpty())
+        return true;
+    Local<v8::Object> s = Nan::New(this->signal);
+    if (To<bool>(s->Get(Nan::New("aborted").ToLocalChecked())).FromJust())
+    {
+        this->cancelled = true;
+        this->checkCancelled();
+        return false;
+    }
+    if (!async)
+        return true;
+
+    this->queuedTask = task;
+    Local<v8::Function> listener = Nan::New<v8::Function>(onAbort, Nan::New<v8::External>(this));
+    this->abortListener.Reset(listener);
+    Local<Value> argv[] = {Nan::New("abort").ToLocalChecked(), listener};
+    Local<Value> add = s->Get(Nan::New("addEventListener").ToLocalChecked());
+    Nan::Call(add.As<v8::Function>(), s, 2, argv);
+    return true;
+}
+
+void NodePopplerPage::RenderWork::unwatchSignal()
+{
+    if (this->abortListener.IsEmpty())
+        return;
+    Nan::HandleScope scope;
+    Local<v8::Object> s = Nan::New(this->signal);
+    Local<Value> argv[] = {Nan::New("abort").ToLocalChecked(), Nan::New(this->abortListener)};
+    Local<Value> remove = s->Get(Nan::New("removeEventListener").ToLocalChecked());
+    if (remove->IsFunction())
+    {
+        Nan::Call(remove.As<v8::Function>(), s, 2, argv);
+    }
+    this->abortListener.Reset();
+    this->signal.Reset();
+}
+
+NAN_METHOD(NodePopplerPage::RenderWork::onAbort)
+{
+    RenderWork *work = static_cast<RenderWork *>(info.Data().As<v8::External>()->Value());
+    work->cancelled = true;
+    if (work->renderStream)
+    {
+        // unblock the encoder waiting for the consumer
+        work->renderStream->abort();
+    }
+    if (work->queuedTask)
+    {
+        RenderThreadPool::get()->cancel(work->queuedTask);
+    }
+}
+
+/**
+     * Splash color mode matching the output format
+     */
+SplashColorMode NodePopplerPage::RenderWork::getColorMode()
+{
+    if (this->w == W_RAW)
+    {
+        switch (this->pixelFormat)
+        {
+        case PF_RGBA:
+        case PF_BGRA:
+            return splashModeXBGR8;
+        case PF_GRAY:
+            return splashModeMono8;
+        case PF_RGB:
+            break;
+        }
+    }
+    switch (this->colorMode)
+    {
+    case CM_GRAY:
+        return splashModeMono8;
+    case CM_MONO:
+        return splashModeMono1;
+    default:
+        return splashModeRGB8;
+    }
+}
+
+/**
+     * Reads rasterizer quality options
+     */
+void NodePopplerPage::RenderWork::setRasterOptions(const Local<v8::Object> options)
+{
+    Nan::HandleScope scope;
+    Local<String> pk = Nan::New("preset").ToLocalChecked();
+    Local<String> vk = Nan::New("vectorAntialias").ToLocalChecked();
+    Local<String> tk = Nan::New("textAntialias").ToLocalChecked();
+    Local<String> lk = Nan::New("thinLineMode").ToLocalChecked();
+    Local<String> hk = Nan::New("hinting").ToLocalChecked();
+    Local<String> dk = Nan::New("draft").ToLocalChecked();
+
+    if (options->Has(pk))
+    {
+        Local<Value> pv = options->Get(pk);
+        Nan::Utf8String preset(pv);
+        if (!pv->IsString())
+        {
+            return this->setError("'preset' option must be an instance of string");
+        }
+        if (strcmp(*preset, "fast") == 0)
+        {
+            this->vectorAntialias = false;
+            this->textAntialias = false;
+            this->draft = true;
+        }
+        else if (strcmp(*preset, "default") != 0)
+        {
+            return this->setError("Unsupported 'preset' option value");
+        }
+    }
+    if (options->Has(vk))
+    {
+        Local<Value> vv = options->Get(vk);
+        if (!vv->IsBoolean())
+        {
+            return this->setError("'vectorAntialias' option value must be a boolean value");
+        }
+        this->vectorAntialias = To<bool>(vv).FromJust();
+    }
+    if (options->Has(tk))
+    {
+        Local<Value> tv = options->Get(tk);
+        if (!tv->IsBoolean())
+        {
+            return this->setError("'textAntialias' option value must be a boolean value");
+        }
+        this->textAntialias = To<bool>(tv).FromJust();
+    }
+    if (options->Has(dk))
+    {
+        Local<Value> dv = options->Get(dk);
+        if (!dv->IsBoolean())
+        {
+            return this->setError("'draft' option value must be a boolean value");
+        }
+        this->draft = To<bool>(dv).FromJust();
+    }
+    if (options->Has(lk))
+    {
+        Local<Value> lv = options->Get(lk);
+        Nan::Utf8String mode(lv);
+        if (!lv->IsString())
+        {
+            return this->setError("'thinLineMode' option must be an instance of string");
+        }
+#if POPPLER_VERSION_MAJOR > 0 || POPPLER_VERSION_MINOR >= 24
+        if (strcmp(*mode, "default") == 0)
+            this->thinLineMode = splashThinLineDefault;
+        else if (strcmp(*mode, "solid") == 0)
+            this->thinLineMode = splashThinLineSolid;
+        else if (strcmp(*mode, "shape") == 0)
+            this->thinLineMode = splashThinLineShape;
+        else
+            return this->setError("Unsupported 'thinLineMode' option value");
+#else
+        if (strcmp(*mode, "default") != 0)
+            return this->setError("'thinLineMode' option requires poppler 0.24 or newer");
+#endif
+    }
+    if (options->Has(hk))
+    {
+        Local<Value> hv = options->Get(hk);
+        Nan::Utf8String mode(hv);
+        if (!hv->IsString())
+        {
+            return this->setError("'hinting' option must be an instance of string");
+        }
+        if (strcmp(*mode, "none") == 0)
+            this->hinting = RendererPool::HINTING_NONE;
+        else if (strcmp(*mode, "slight") == 0)
+            this->hinting = RendererPool::HINTING_SLIGHT;
+        else if (strcmp(*mode, "full") == 0)
+            this->hinting = RendererPool::HINTING_FULL;
+        else
+            return this->setError("Unsupported 'hinting' option value");
+    }
+}
+
+/**
+     * Output device settings of the work
+     */
+RendererPool::DeviceSettings NodePopplerPage::RenderWork::getDeviceSettings()
+{
+    RendererPool::DeviceSettings settings;
+    settings.mode = this->getColorMode();
+    settings.vectorAntialias = this->vectorAntialias;
+    settings.textAntialias = this->textAntialias;
+    settings.thinLineMode = this->thinLineMode;
+    settings.hinting = this->hinting;
+    return settings;
+}
+
+/**
+     * Creates image encoder for the output format, NULL for 'raw'
+     */
+ImgWriter *NodePopplerPage::RenderWork::createWriter()
+{
+    ImgWriter *writer = NULL;
+    switch (this->w)
+    {
+    case W_PNG:
+    {
+        PngStreamWriter *png = new PngStreamWriter(this->colorMode == CM_GRAY ? PngStreamWriter::GRAY : this->colorMode == CM_MONO ? PngStreamWriter::MONOCHROME : PngStreamWriter::RGB);
+        png->setCompressionLevel(this->pngLevel);
+        png->setStrategy(this->pngStrategy);
+        png->setFilter(this->pngFilter);
+        png->setPalette(this->palette);
+        writer = png;
+    }
+    break;
+    case W_JPEG:
+    {
+        JpegStreamWriter *jpeg = new JpegStreamWriter(this->colorMode == CM_GRAY ? JpegStreamWriter::GRAY : JpegStreamWriter::RGB);
+        jpeg->setQuality(this->quality);
+        jpeg->setProgressive(this->progressive);
+        jpeg->setSubsampling(this->subsampling);
+        jpeg->setDctMethod(this->dctMethod);
+        jpeg->setOptimize(this->optimize);
+        jpeg->setRestartInterval(this->restartInterval);
+        writer = jpeg;
+    }
+    break;
+    case W_TIFF:
+        writer = new TiffStreamWriter(this->colorMode == CM_GRAY ? TiffStreamWriter::GRAY : this->colorMode == CM_MONO ? TiffStreamWriter::MONOCHROME : TiffStreamWriter::RGB);
+        if (this->compression != NULL)
+        {
+            ((TiffStreamWriter *)writer)->setCompressionString(this->compression);
+        }
+        else if (this->colorMode == CM_MONO)
+        {
+            // bilevel pages compress best with fax coding
+            ((TiffStreamWriter *)writer)->setCompressionString("ccittfax4");
+        }
+        break;
+    case W_RAW:
+        break;
+    }
+    return writer;
+}
+
+/**
+     * Builds render cache key from the document state and all settings
+     * affecting the output
+     */
+void NodePopplerPage::RenderWork::setCacheKey()
+{
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%lu:%lu:", parent->getId(), parent->getGeneration());
+    this->cacheKey = prefix + renderParams();
+}
+
+/**
+     * Describes all settings affecting the output of a page
+     */
+std::string NodePopplerPage::RenderWork::renderParams()
+{
+    char params[512];
+    snprintf(params, sizeof(params), "%d:%.17g:%.17g,%.17g,%.17g,%.17g:%s:%d:%d:%s:%d:%d",
+             pg->getNum(), PPI,
+             slice_x, slice_y, slice_w, slice_h,
+             format, quality, progressive ? 1 : 0,
+             compression ? compression : "", (int)pixelFormat, (int)colorMode);
+    snprintf(params + strlen(params), sizeof(params) - strlen(params), ":%d%d%d:%d",
+             (int)subsampling, (int)dctMethod, optimize ? 1 : 0, restartInterval);
+    snprintf(params + strlen(params), sizeof(params) - strlen(params), ":%d%d%d%d",
+             pngLevel, (int)pngStrategy, (int)pngFilter, palette ? 1 : 0);
+    snprintf(params + strlen(params), sizeof(params) - strlen(params), ":%d", bandHeight);
+    snprintf(params + strlen(params), sizeof(params) - strlen(params), ":%d%d%d%d%d",
+             vectorAntialias ? 1 : 0, textAntialias ? 1 : 0, thinLineMode, (int)hinting, draft ? 1 : 0);
+    return params;
+}
+
+/**
+     * Takes output from the render cache, returns false on a miss.
+     * Sets the error if the entry doesn't fit into the output buffer.
+     */
+bool NodePopplerPage::RenderWork::loadFromCache()
+{
+    const RenderCache::Entry *entry = RenderCache::get()->lookup(this->cacheKey);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    if (this->outputData != NULL && (entry->length <= this->outputCapacity || !this->outputFallback))
+    {
+        // a render would produce the same bytes, fail without it
+        if (!this->copyToOutput(entry->data, entry->length))
+        {
+            this->setOutputTooSmall(entry->length);
+            return true;
+        }
+    }
+    else
+    {
+        this->mstrm_buf = (char *)malloc(entry->length > 0 ? entry->length : 1);
+        if (this->mstrm_buf == NULL)
+        {
+            return false;
+        }
+        memcpy(this->mstrm_buf, entry->data, entry->length);
+    }
+    this->mstrm_len = entry->length;
+    this->width = entry->width;
+    this->height = entry->height;
+    this->stride = entry->stride;
+    // nothing new to store
+    this->cacheKey.clear();
+    return true;
+}
+
+/**
+     * Puts rendered output to the render cache if it was looked up there
+     */
+void NodePopplerPage::RenderWork::storeInCache()
+{
+    const char *data = this->inOutput ? this->outputData : this->mstrm_buf;
+    if (this->cacheKey.empty() || this->error != NULL || data == NULL)
+    {
+        return;
+    }
+    RenderCache::get()->insert(this->cacheKey, parent->getId(),
+                               data, this->mstrm_len,
+                               this->width, this->height, this->stride);
+}
+
+/**
+     * Copies render settings parsed by another work
+     */
+void NodePopplerPage::RenderWork::copySettings(const RenderWork *other)
+{
+    this->w = other->w;
+    strcpy(this->format, other->format);
+    this->pixelFormat = other->pixelFormat;
+    this->colorMode = other->colorMode;
+    this->quality = other->quality;
+    this->progressive = other->progressive;
+    this->subsampling = other->subsampling;
+    this->dctMethod = other->dctMethod;
+    this->optimize = other->optimize;
+    this->restartInterval = other->restartInterval;
+    this->pngLevel = other->pngLevel;
+    this->pngStrategy = other->pngStrategy;
+    this->pngFilter = other->pngFilter;
+    this->palette = other->palette;
+    this->bandHeight = other->bandHeight;
+    if (other->compression)
+    {
+        this->compression = new char[strlen(other->compression) + 1];
+        strcpy(this->compression, other->compression);
+    }
+    this->PPI = other->PPI;
+    this->slice_x = other->slice_x;
+    this->slice_y = other->slice_y;
+    this->slice_w = other->slice_w;
+    this->slice_h = other->slice_h;
+    this->maxRenderMs = other->maxRenderMs;
+    this->maxOperations = other->maxOperations;
+    this->vectorAntialias = other->vectorAntialias;
+    this->textAntialias = other->textAntialias;
+    this->thinLineMode = other->thinLineMode;
+    this->hinting = other->hinting;
+    this->draft = other->draft;
+}
+
 void NodePopplerPage::RenderWork::setSlice(const Local<Value> sliceVal)
 {
     Nan::HandleScope scope;
@@ -1263,6 +2866,86 @@ void NodePopplerPage::RenderWork::setSlice(const Local<Value> sliceVal)
     }
 }
 
+/**
+     * Reads `output` and `outputFallback` options of renderToBuffer.
+     *
+     * `output` is a Buffer to write the result into or a pool object
+     * whose `acquire()` method returns one.
+     */
+void NodePopplerPage::RenderWork::setOutput(const Local<Value> optsVal)
+{
+    Nan::HandleScope scope;
+    Local<v8::Object> options = To<v8::Object>(optsVal).ToLocalChecked();
+    Local<String> ok = Nan::New("output").ToLocalChecked();
+    Local<String> fk = Nan::New("outputFallback").ToLocalChecked();
+
+    if (options->Has(fk))
+    {
+        Local<Value> fv = options->Get(fk);
+        if (!fv->IsBoolean())
+        {
+            return this->setError("'outputFallback' option value must be a boolean value");
+        }
+        this->outputFallback = To<bool>(fv).FromJust();
+    }
+    if (!options->Has(ok))
+    {
+        return;
+    }
+    Local<Value> ov = options->Get(ok);
+    if (ov->IsObject() && !node::Buffer::HasInstance(ov))
+    {
+        Local<v8::Object> pool = To<v8::Object>(ov).ToLocalChecked();
+        Local<Value> acquire = Nan::Get(pool, Nan::New("acquire").ToLocalChecked()).ToLocalChecked();
+        if (!acquire->IsFunction())
+        {
+            return this->setError("'output' option must be a Buffer or an object with 'acquire' method");
+        }
+        Nan::TryCatch try_catch;
+        Nan::MaybeLocal<Value> acquired = Nan::Call(acquire.As<v8::Function>(), pool, 0, NULL);
+        if (try_catch.HasCaught() || acquired.IsEmpty())
+        {
+            return this->setError("Could not acquire 'output' buffer from pool");
+        }
+        ov = acquired.ToLocalChecked();
+        if (!node::Buffer::HasInstance(ov))
+        {
+            return this->setError("'output' pool must return a Buffer");
+        }
+    }
+    else if (!node::Buffer::HasInstance(ov))
+    {
+        return this->setError("'output' option must be a Buffer or an object with 'acquire' method");
+    }
+    this->outputHandle.Reset(To<v8::Object>(ov).ToLocalChecked());
+    this->outputData = node::Buffer::Data(ov);
+    this->outputCapacity = node::Buffer::Length(ov);
+}
+
+/**
+     * Copies finished output into the output buffer, false if it
+     * doesn't fit
+     */
+bool NodePopplerPage::RenderWork::copyToOutput(const char *data, size_t length)
+{
+    if (length > this->outputCapacity)
+    {
+        return false;
+    }
+    memcpy(this->outputData, data, length);
+    this->mstrm_len = length;
+    this->inOutput = true;
+    return true;
+}
+
+void NodePopplerPage::RenderWork::setOutputTooSmall(size_t length)
+{
+    char err[128];
+    snprintf(err, sizeof(err), "Render output of %lu bytes doesn't fit into 'output' buffer",
+             (unsigned long)length);
+    this->setError(err, "ERR_OUTPUT_TOO_SMALL");
+}
+
 /**
      * Opens output stream for rendering
      */
@@ -1285,22 +2968,21 @@ void NodePopplerPage::RenderWork::openStream()
     break;
     case DEST_BUFFER:
     {
-        if (this->w != W_TIFF)
+        if (this->w == W_RAW)
         {
-            this->stream = new MemoryStream();
-            this->f = this->stream->open();
+            // pixels are taken straight from the bitmap
+            return;
         }
+        if (this->outputData != NULL)
+            this->stream = new MemoryStream(this->outputData, this->outputCapacity, this->outputFallback);
         else
-        {
-            this->filename = new char[17];
-            strcpy(this->filename, "/tmp/psmplXXXXXX");
-            int fd = mkstemp(this->filename);
-            if (fd != -1)
-            {
-                this->f = fdopen(fd, "wb");
-            }
-        }
+            this->stream = new MemoryStream();
+        this->f = this->stream->open();
     }
+    break;
+    case DEST_STREAM:
+        this->f = this->renderStream->open();
+        break;
     }
     if (!this->f)
     {
@@ -1313,6 +2995,60 @@ void NodePopplerPage::RenderWork::openStream()
     }
 }
 
+/**
+     * Frees encoder output owned by a Node Buffer
+     */
+static void freeRenderBuffer(char *data, void *hint)
+{
+    free(data);
+}
+
+/**
+     * Hands encoder output over to a Node Buffer without copying it
+     */
+Local<v8::Object> NodePopplerPage::RenderWork::takeBuffer()
+{
+    if (this->inOutput)
+    {
+        // a view of the caller's buffer holding the output
+        Local<v8::Object> output = Nan::New(this->outputHandle);
+        Local<Value> slice = Nan::Get(output, Nan::New("slice").ToLocalChecked()).ToLocalChecked();
+        Local<Value> argv[] = {Nan::New<Number>(0), Nan::New<Number>(this->mstrm_len)};
+        return To<v8::Object>(Nan::Call(slice.As<v8::Function>(), output, 2, argv).ToLocalChecked()).ToLocalChecked();
+    }
+    if (this->mstrm_buf == NULL)
+    {
+        return Nan::NewBuffer(0).ToLocalChecked();
+    }
+    Local<v8::Object> buffer = Nan::NewBuffer(
+                                   this->mstrm_buf, this->mstrm_len,
+                                   freeRenderBuffer, NULL)
+                                   .ToLocalChecked();
+    this->mstrm_buf = NULL;
+    return buffer;
+}
+
+/**
+     * Builds `renderToBuffer` result object
+     */
+Local<v8::Object> NodePopplerPage::RenderWork::bufferResult()
+{
+    Local<v8::Object> out = Nan::New<v8::Object>();
+    out->Set(Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
+    out->Set(Nan::New("format").ToLocalChecked(), Nan::New(this->format).ToLocalChecked());
+    out->Set(Nan::New("data").ToLocalChecked(), this->takeBuffer());
+    if (this->w == W_RAW)
+    {
+        const char *pixelFormatNames[] = {"rgb", "rgba", "bgra", "gray"};
+        out->Set(Nan::New("width").ToLocalChecked(), Nan::New<Int32>(this->width));
+        out->Set(Nan::New("height").ToLocalChecked(), Nan::New<Int32>(this->height));
+        out->Set(Nan::New("stride").ToLocalChecked(), Nan::New<Int32>(this->stride));
+        out->Set(Nan::New("pixelFormat").ToLocalChecked(),
+                 Nan::New(pixelFormatNames[this->pixelFormat]).ToLocalChecked());
+    }
+    return out;
+}
+
 /**
      * Closes output stream
      */
@@ -1325,39 +3061,37 @@ void NodePopplerPage::RenderWork::closeStream()
         this->f = NULL;
         break;
     case DEST_BUFFER:
-    {
-        if (this->w != W_TIFF)
+        if (this->w == W_RAW || this->stream == NULL)
+            break;
+        fclose(this->f);
+        this->f = NULL;
+        this->mstrm_len = this->stream->getBufferLen();
+        if (this->stream->hasOverflown())
         {
-            fclose(this->f);
-            this->f = NULL;
-            this->mstrm_len = this->stream->getBufferLen();
-            this->mstrm_buf = this->stream->giveBuffer();
+            if (this->error == NULL)
+            {
+                this->setOutputTooSmall(this->mstrm_len);
+            }
+        }
+        else if (this->stream->isExternal())
+        {
+            this->inOutput = true;
         }
         else
         {
-            struct stat s;
-            int filedes;
-            filedes = open(this->filename, O_RDONLY);
-            fstat(filedes, &s);
-            if (s.st_size > 0)
+            this->mstrm_buf = this->stream->giveBuffer();
+        }
+        break;
+    case DEST_STREAM:
+        if (this->f)
+        {
+            if (fclose(this->f) != 0 && this->error == NULL)
             {
-                this->mstrm_len = s.st_size;
-                this->mstrm_buf = (char *)malloc(this->mstrm_len);
-                ssize_t count = read(filedes, this->mstrm_buf, this->mstrm_len);
-                if (count != (ssize_t)this->mstrm_len && this->error == NULL)
-                {
-                    char err[256];
-                    sprintf(err, "Can't read temporary file");
-                    this->error = new char[strlen(err) + 1];
-                    strcpy(this->error, err);
-                }
+                this->setError("Could not write to render stream");
             }
-            close(filedes);
-            fclose(this->f);
-            unlink(this->filename);
             this->f = NULL;
         }
-    }
+        break;
     }
 }
 } // namespace node
@@ -13,20 +13,29 @@
 #include <splash/SplashErrorCodes.h>
 #include <goo/gtypes.h>
 #include <goo/ImgWriter.h>
-#include <goo/PNGWriter.h>
-#include <goo/TiffWriter.h>
-#include <goo/JpegWriter.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <tuple>
+#include <string>
+#include <atomic>
 
 #include "iconv_string.h"
 #include "MemoryStream.h"
+#include "TiffStreamWriter.h"
+#include "JpegStreamWriter.h"
+#include "PngStreamWriter.h"
+#include "BitmapUtils.h"
+#include "RendererPool.h"
+#include "RenderThreadPool.h"
+#include "RenderStream.h"
+#include "RenderCache.h"
+#include "DiskCache.h"
 
 namespace node
 {
 class NodePopplerDocument;
+struct AnnotChange;
 class NodePopplerPage : public Nan::ObjectWrap
 {
   public:
@@ -34,21 +43,43 @@ class NodePopplerPage : public Nan::ObjectWrap
     {
         W_PNG,
         W_JPEG,
-        W_TIFF /*, W_PIXBUF*/
+        W_TIFF,
+        W_RAW /*, W_PIXBUF*/
+    };
+    enum PixelFormat
+    {
+        PF_RGB,
+        PF_RGBA,
+        PF_BGRA,
+        PF_GRAY
+    };
+    enum ColorMode
+    {
+        CM_RGB,
+        CM_GRAY,
+        CM_MONO
+    };
+    enum Limit
+    {
+        LIMIT_NONE,
+        LIMIT_TIME,
+        LIMIT_OPERATIONS
     };
     enum Destination
     {
         DEST_BUFFER,
-        DEST_FILE
+        DEST_FILE,
+        DEST_STREAM
     };
 
     class RenderWork
     {
       public:
-        RenderWork(NodePopplerPage *self, NodePopplerPage::Destination dest)
-            : callback(NULL), progressive(false), error(NULL), mstrm_buf(NULL), filename(NULL), compression(NULL), quality(100), slice_x(0), slice_y(0), slice_w(1), slice_h(1), PPI(72), f(NULL), stream(NULL), mstrm_len(0), w(W_JPEG)
+        RenderWork(NodePopplerDocument *parent, Page *pg, NodePopplerPage::Destination dest)
+            : callback(NULL), progressive(false), error(NULL), mstrm_buf(NULL), filename(NULL), compression(NULL), quality(100), subsampling(JpegStreamWriter::SUBSAMPLING_420), dctMethod(JpegStreamWriter::DCT_ACCURATE), optimize(false), restartInterval(0), pngLevel(-1), pngStrategy(PngStreamWriter::STRATEGY_AUTO), pngFilter(PngStreamWriter::FILTER_AUTO), palette(false), slice_x(0), slice_y(0), slice_w(1), slice_h(1), PPI(72), f(NULL), stream(NULL), mstrm_len(0), width(0), height(0), stride(0), w(W_JPEG), pixelFormat(PF_RGB), colorMode(CM_RGB), annotated(false), renderStream(NULL), useDiskCache(false), errorCode(NULL), cancelled(false), cancelFlag(&cancelled), queuedTask(NULL), maxRenderMs(0), maxOperations(0), renderStart(0), abortChecks(0), limit(LIMIT_NONE), vectorAntialias(true), textAntialias(true), thinLineMode(0), hinting(RendererPool::HINTING_NONE), draft(false), bandHeight(0), outputData(NULL), outputCapacity(0), outputFallback(false), inOutput(false)
         {
-            this->self = self;
+            this->parent = parent;
+            this->pg = pg;
             this->dest = dest;
             request.data = this;
             format[0] = '\0';
@@ -69,17 +100,65 @@ class NodePopplerPage : public Nan::ObjectWrap
                 fclose(f);
             if (stream)
                 delete stream;
+            if (renderStream)
+                renderStream->close();
+            unwatchSignal();
+            streamHandle.Reset();
+            docHandle.Reset();
+            outputHandle.Reset();
         }
         void setWriter(const v8::Local<v8::Value> method);
         void setWriterOptions(const v8::Local<v8::Value> optsVal);
         void setPPI(const v8::Local<v8::Value> PPI);
         void setPath(const v8::Local<v8::Value> path);
         void setSlice(const v8::Local<v8::Value> sliceVal);
+        void setOutput(const v8::Local<v8::Value> optsVal);
+        bool copyToOutput(const char *data, size_t length);
+        void setOutputTooSmall(size_t length);
+        void copySettings(const RenderWork *other);
+        void setError(const char *e, const char *code = NULL);
+        v8::Local<v8::Value> errorValue();
+        void setSignal(const v8::Local<v8::Value> signalVal);
+        bool watchSignal(bool async, RenderTask *task);
+        void unwatchSignal();
+        bool checkCancelled();
+        void setLimits(const v8::Local<v8::Object> options);
+        bool isOverLimit();
+        bool checkLimits();
+        bool isCancelled()
+        {
+            return cancelFlag->load();
+        }
         void openStream();
         void closeStream();
-        std::tuple<int, int, int, int> applyScale();
+        v8::Local<v8::Object> takeBuffer();
+        v8::Local<v8::Object> bufferResult();
+        std::tuple<int, int, int, int> applyScale(bool banded = false);
+        int getBandRows(int width, int height);
+        size_t estimateOutputSize(int width, int height);
+        SplashColorMode getColorMode();
+        void setRasterOptions(const v8::Local<v8::Object> options);
+        RendererPool::DeviceSettings getDeviceSettings();
+        ImgWriter *createWriter();
+        std::string renderParams();
+        void setCacheKey();
+        bool loadFromCache();
+        void storeInCache();
 
-        uv_work_t request;
+        double getPageWidth()
+        {
+            return ((pg->getRotate() == 90 || pg->getRotate() == 270)
+                        ? pg->getCropHeight()
+                        : pg->getCropWidth());
+        }
+        double getPageHeight()
+        {
+            return ((pg->getRotate() == 90 || pg->getRotate() == 270)
+                        ? pg->getCropWidth()
+                        : pg->getCropHeight());
+        }
+
+        RenderTask request;
         Nan::Callback *callback;
         bool progressive;
         char *error;
@@ -88,6 +167,14 @@ class NodePopplerPage : public Nan::ObjectWrap
         char *compression;
         char format[5];
         int quality;
+        JpegStreamWriter::Subsampling subsampling;
+        JpegStreamWriter::DctMethod dctMethod;
+        bool optimize;
+        int restartInterval;
+        int pngLevel;
+        PngStreamWriter::Strategy pngStrategy;
+        PngStreamWriter::Filter pngFilter;
+        bool palette;
         double slice_x;
         double slice_y;
         double slice_w;
@@ -96,9 +183,50 @@ class NodePopplerPage : public Nan::ObjectWrap
         FILE *f;
         MemoryStream *stream;
         size_t mstrm_len;
+        int width;
+        int height;
+        int stride;
         NodePopplerPage::Writer w;
+        NodePopplerPage::PixelFormat pixelFormat;
+        NodePopplerPage::ColorMode colorMode;
         NodePopplerPage::Destination dest;
-        NodePopplerPage *self;
+        NodePopplerDocument *parent;
+        Page *pg;
+        // document has added annotations, which disk cache keys don't cover
+        bool annotated;
+        Nan::Persistent<v8::Object> docHandle;
+        RenderStream *renderStream;
+        Nan::Persistent<v8::Object> streamHandle;
+        std::string cacheKey;
+        bool useDiskCache;
+        const char *errorCode;
+        std::atomic<bool> cancelled;
+        // flag renders of the work stop on, of another work for batches
+        std::atomic<bool> *cancelFlag;
+        RenderTask *queuedTask;
+        Nan::Persistent<v8::Object> signal;
+        Nan::Persistent<v8::Function> abortListener;
+        double maxRenderMs;
+        unsigned long maxOperations;
+        uint64_t renderStart;
+        unsigned long abortChecks;
+        NodePopplerPage::Limit limit;
+        bool vectorAntialias;
+        bool textAntialias;
+        int thinLineMode;
+        RendererPool::Hinting hinting;
+        bool draft;
+        int bandHeight;
+        // caller supplied output buffer of renderToBuffer
+        Nan::Persistent<v8::Object> outputHandle;
+        char *outputData;
+        size_t outputCapacity;
+        bool outputFallback;
+        // result is in the output buffer rather than in mstrm_buf
+        bool inOutput;
+
+      private:
+        static NAN_METHOD(onAbort);
     };
 
     NodePopplerPage(NodePopplerDocument *doc, const int32_t pageNum);
@@ -131,7 +259,11 @@ class NodePopplerPage : public Nan::ObjectWrap
     double getRotate() { return pg->getRotate(); }
     bool isDocClosed() { return docClosed; }
 
+    static SplashOutputDev *rasterize(RenderWork *work, RendererPool::Renderer **renderer);
+    static SplashOutputDev *rasterizeRect(RenderWork *work, int sx, int sy, int sw, int sh, RendererPool::Renderer **renderer);
     static void display(RenderWork *work);
+    static bool applyAnnotChange(PDFDoc *doc, Page *pg, const AnnotChange &change);
+    static SplashError displayBands(RenderWork *work, ImgWriter *writer, int sx, int sy, int sw, int sh, int rows);
 
   protected:
     static NAN_METHOD(New);
@@ -139,14 +271,18 @@ class NodePopplerPage : public Nan::ObjectWrap
     static NAN_METHOD(getWordList);
     static NAN_METHOD(renderToFile);
     static NAN_METHOD(renderToBuffer);
+    static NAN_METHOD(renderToChunks);
+    static NAN_METHOD(renderTiles);
+    static NAN_METHOD(renderVariants);
+    static NAN_METHOD(estimateCost);
 #if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 20
 #else
     static NAN_METHOD(addAnnot);
 #endif
     static NAN_METHOD(deleteAnnots);
 
-    static void AsyncRenderWork(uv_work_t *req);
-    static void AsyncRenderAfter(uv_work_t *req, int status);
+    static void AsyncRenderWork(RenderTask *req);
+    static void AsyncRenderAfter(RenderTask *req, int status);
     void parseAnnot(const v8::Local<v8::Value> rect,
                     double *x1, double *y1,
                     double *x2, double *y2,
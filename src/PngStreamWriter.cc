@@ -0,0 +1,413 @@
+#include <string.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <png.h>
+#include <zlib.h>
+
+#include "PngStreamWriter.h"
+
+struct PngStreamWriterPrivate
+{
+    png_structp png;
+    png_infop info;
+    std::vector<unsigned char> colors;
+    std::vector<unsigned char> indices;
+};
+
+/**
+ * Maps RGB pixels to an exact palette. Returns false if the pixels
+ * have more than 256 distinct colors.
+ */
+static bool exactPalette(const unsigned char *rgb, size_t count,
+                         std::vector<unsigned char> &colors, std::vector<unsigned char> &indices)
+{
+    std::unordered_map<uint32_t, int> map;
+    uint32_t last = 0xffffffff;
+    int lastIndex = 0;
+    indices.resize(count);
+    for (size_t i = 0; i < count; i++, rgb += 3)
+    {
+        uint32_t c = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+        if (c != last)
+        {
+            std::unordered_map<uint32_t, int>::iterator it = map.find(c);
+            if (it == map.end())
+            {
+                if (map.size() == 256)
+                    return false;
+                lastIndex = (int)map.size();
+                map[c] = lastIndex;
+                colors.push_back(rgb[0]);
+                colors.push_back(rgb[1]);
+                colors.push_back(rgb[2]);
+            }
+            else
+            {
+                lastIndex = it->second;
+            }
+            last = c;
+        }
+        indices[i] = (unsigned char)lastIndex;
+    }
+    return true;
+}
+
+#define QBITS 5
+#define QSIZE (1 << QBITS)
+#define QBIN(r, g, b) ((((r) >> (8 - QBITS)) << (2 * QBITS)) | (((g) >> (8 - QBITS)) << QBITS) | ((b) >> (8 - QBITS)))
+
+struct QuantBin
+{
+    uint64_t count;
+    uint64_t sum[3];
+};
+
+struct QuantBox
+{
+    int lo[3];
+    int hi[3];
+    uint64_t count;
+};
+
+/**
+ * Shrinks the box to its populated bins and counts its pixels
+ */
+static void shrinkBox(const std::vector<QuantBin> &hist, QuantBox &box)
+{
+    int lo[3] = {QSIZE, QSIZE, QSIZE};
+    int hi[3] = {-1, -1, -1};
+    box.count = 0;
+    for (int r = box.lo[0]; r <= box.hi[0]; r++)
+        for (int g = box.lo[1]; g <= box.hi[1]; g++)
+            for (int b = box.lo[2]; b <= box.hi[2]; b++)
+            {
+                const QuantBin &bin = hist[(r << (2 * QBITS)) | (g << QBITS) | b];
+                if (bin.count == 0)
+                    continue;
+                box.count += bin.count;
+                int c[3] = {r, g, b};
+                for (int k = 0; k < 3; k++)
+                {
+                    if (c[k] < lo[k])
+                        lo[k] = c[k];
+                    if (c[k] > hi[k])
+                        hi[k] = c[k];
+                }
+            }
+    if (box.count > 0)
+    {
+        memcpy(box.lo, lo, sizeof(lo));
+        memcpy(box.hi, hi, sizeof(hi));
+    }
+}
+
+/**
+ * Median cut quantization of RGB pixels to at most 256 colors
+ */
+static void quantizePalette(const unsigned char *rgb, size_t count,
+                            std::vector<unsigned char> &colors, std::vector<unsigned char> &indices)
+{
+    std::vector<QuantBin> hist(QSIZE * QSIZE * QSIZE);
+    memset(&hist[0], 0, hist.size() * sizeof(QuantBin));
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *p = rgb + 3 * i;
+        QuantBin &bin = hist[QBIN(p[0], p[1], p[2])];
+        bin.count++;
+        bin.sum[0] += p[0];
+        bin.sum[1] += p[1];
+        bin.sum[2] += p[2];
+    }
+
+    std::vector<QuantBox> boxes;
+    QuantBox all = {{0, 0, 0}, {QSIZE - 1, QSIZE - 1, QSIZE - 1}, 0};
+    shrinkBox(hist, all);
+    boxes.push_back(all);
+    while (boxes.size() < 256)
+    {
+        // split the box with most pixels weighted by its longest side
+        int best = -1;
+        int axis = 0;
+        uint64_t bestScore = 0;
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint64_t score = boxes[i].count * (uint64_t)(boxes[i].hi[k] - boxes[i].lo[k]);
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = (int)i;
+                    axis = k;
+                }
+            }
+        }
+        if (best < 0)
+            break;
+
+        QuantBox &box = boxes[best];
+        std::vector<uint64_t> slices(QSIZE, 0);
+        for (int r = box.lo[0]; r <= box.hi[0]; r++)
+            for (int g = box.lo[1]; g <= box.hi[1]; g++)
+                for (int b = box.lo[2]; b <= box.hi[2]; b++)
+                {
+                    int c[3] = {r, g, b};
+                    slices[c[axis]] += hist[(r << (2 * QBITS)) | (g << QBITS) | b].count;
+                }
+        uint64_t acc = 0;
+        int split = box.lo[axis];
+        for (; split < box.hi[axis] - 1; split++)
+        {
+            acc += slices[split];
+            if (acc * 2 >= box.count)
+                break;
+        }
+        QuantBox upper = box;
+        box.hi[axis] = split;
+        upper.lo[axis] = split + 1;
+        shrinkBox(hist, box);
+        shrinkBox(hist, upper);
+        boxes.push_back(upper);
+    }
+
+    std::vector<int> binIndex(hist.size(), -1);
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        const QuantBox &box = boxes[i];
+        uint64_t sum[3] = {0, 0, 0};
+        for (int r = box.lo[0]; r <= box.hi[0]; r++)
+            for (int g = box.lo[1]; g <= box.hi[1]; g++)
+                for (int b = box.lo[2]; b <= box.hi[2]; b++)
+                {
+                    const QuantBin &bin = hist[(r << (2 * QBITS)) | (g << QBITS) | b];
+                    for (int k = 0; k < 3; k++)
+                        sum[k] += bin.sum[k];
+                }
+        for (int k = 0; k < 3; k++)
+            colors.push_back(box.count ? (unsigned char)((sum[k] + box.count / 2) / box.count) : 0);
+    }
+
+    // nearest palette entry for each populated bin
+    size_t paletteSize = colors.size() / 3;
+    for (size_t i = 0; i < hist.size(); i++)
+    {
+        const QuantBin &bin = hist[i];
+        if (bin.count == 0)
+            continue;
+        int c[3];
+        for (int k = 0; k < 3; k++)
+            c[k] = (int)(bin.sum[k] / bin.count);
+        int bestDist = 0x7fffffff;
+        for (size_t j = 0; j < paletteSize; j++)
+        {
+            int dr = c[0] - colors[3 * j];
+            int dg = c[1] - colors[3 * j + 1];
+            int db = c[2] - colors[3 * j + 2];
+            int dist = dr * dr + dg * dg + db * db;
+            if (dist < bestDist)
+            {
+                bestDist = dist;
+                binIndex[i] = (int)j;
+            }
+        }
+    }
+    indices.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *p = rgb + 3 * i;
+        indices[i] = (unsigned char)binIndex[QBIN(p[0], p[1], p[2])];
+    }
+}
+
+PngStreamWriter::PngStreamWriter(Format format)
+    : priv(NULL), format(format), level(-1), strategy(STRATEGY_AUTO), filter(FILTER_AUTO),
+      palette(false), width(0), height(0), hDPI(0), vDPI(0), curRow(0)
+{
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    if (priv)
+    {
+        png_destroy_write_struct(&priv->png, &priv->info);
+        delete priv;
+    }
+}
+
+void PngStreamWriter::setCompressionLevel(int level)
+{
+    this->level = level;
+}
+
+void PngStreamWriter::setStrategy(Strategy strategy)
+{
+    this->strategy = strategy;
+}
+
+void PngStreamWriter::setFilter(Filter filter)
+{
+    this->filter = filter;
+}
+
+void PngStreamWriter::setPalette(bool palette)
+{
+    this->palette = palette;
+}
+
+bool PngStreamWriter::init(FILE *f, int width, int height, IMG_WRITER_DPI hDPI, IMG_WRITER_DPI vDPI)
+{
+    if (f == NULL || priv != NULL)
+        return false;
+
+    priv = new PngStreamWriterPrivate();
+    priv->info = NULL;
+    priv->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (priv->png == NULL)
+        return false;
+    priv->info = png_create_info_struct(priv->png);
+    if (priv->info == NULL)
+        return false;
+    if (setjmp(png_jmpbuf(priv->png)))
+        return false;
+
+    png_init_io(priv->png, f);
+    if (level >= 0)
+        png_set_compression_level(priv->png, level);
+    switch (strategy)
+    {
+    case STRATEGY_AUTO:
+        break;
+    case STRATEGY_DEFAULT:
+        png_set_compression_strategy(priv->png, Z_DEFAULT_STRATEGY);
+        break;
+    case STRATEGY_FILTERED:
+        png_set_compression_strategy(priv->png, Z_FILTERED);
+        break;
+    case STRATEGY_HUFFMAN:
+        png_set_compression_strategy(priv->png, Z_HUFFMAN_ONLY);
+        break;
+    case STRATEGY_RLE:
+        png_set_compression_strategy(priv->png, Z_RLE);
+        break;
+    case STRATEGY_FIXED:
+        png_set_compression_strategy(priv->png, Z_FIXED);
+        break;
+    }
+    static const int filters[] = {0, PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP,
+                                  PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS};
+    if (filter != FILTER_AUTO)
+        png_set_filter(priv->png, PNG_FILTER_TYPE_BASE, filters[filter]);
+
+    this->width = width;
+    this->height = height;
+    this->hDPI = hDPI;
+    this->vDPI = vDPI;
+    curRow = 0;
+    if (palette && format == RGB)
+    {
+        // the palette needs all pixels, rows are written on close()
+        pixels.reserve((size_t)width * height * 3);
+        return true;
+    }
+    switch (format)
+    {
+    case RGB:
+        return writeHeader(PNG_COLOR_TYPE_RGB, 8);
+    case GRAY:
+        return writeHeader(PNG_COLOR_TYPE_GRAY, 8);
+    case MONOCHROME:
+        return writeHeader(PNG_COLOR_TYPE_GRAY, 1);
+    }
+    return false;
+}
+
+bool PngStreamWriter::writeHeader(int colorType, int bitDepth)
+{
+    if (setjmp(png_jmpbuf(priv->png)))
+        return false;
+    png_set_IHDR(priv->png, priv->info, width, height, bitDepth, colorType,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (colorType == PNG_COLOR_TYPE_PALETTE)
+    {
+        int count = (int)priv->colors.size() / 3;
+        png_color entries[256];
+        for (int i = 0; i < count; i++)
+        {
+            entries[i].red = priv->colors[3 * i];
+            entries[i].green = priv->colors[3 * i + 1];
+            entries[i].blue = priv->colors[3 * i + 2];
+        }
+        png_set_PLTE(priv->png, priv->info, entries, count);
+    }
+    png_set_pHYs(priv->png, priv->info, (png_uint_32)(hDPI / 0.0254), (png_uint_32)(vDPI / 0.0254), PNG_RESOLUTION_METER);
+    png_write_info(priv->png, priv->info);
+    if (bitDepth < 8 && colorType == PNG_COLOR_TYPE_PALETTE)
+    {
+        // indices are one per byte
+        png_set_packing(priv->png);
+    }
+    return true;
+}
+
+bool PngStreamWriter::writePalette()
+{
+    size_t count = (size_t)width * height;
+    if (pixels.size() != count * 3)
+        return false;
+    if (!exactPalette(&pixels[0], count, priv->colors, priv->indices))
+    {
+        priv->colors.clear();
+        quantizePalette(&pixels[0], count, priv->colors, priv->indices);
+    }
+    std::vector<unsigned char>().swap(pixels);
+
+    size_t colors = priv->colors.size() / 3;
+    int bitDepth = colors <= 2 ? 1 : colors <= 4 ? 2 : colors <= 16 ? 4 : 8;
+    if (!writeHeader(PNG_COLOR_TYPE_PALETTE, bitDepth))
+        return false;
+    if (setjmp(png_jmpbuf(priv->png)))
+        return false;
+    for (int y = 0; y < height; y++)
+    {
+        png_write_row(priv->png, &priv->indices[(size_t)y * width]);
+    }
+    return true;
+}
+
+bool PngStreamWriter::writePointers(unsigned char **rowPointers, int rowCount)
+{
+    for (int i = 0; i < rowCount; i++)
+    {
+        if (!writeRow(&rowPointers[i]))
+            return false;
+    }
+    return true;
+}
+
+bool PngStreamWriter::writeRow(unsigned char **row)
+{
+    if (priv == NULL || curRow >= height)
+        return false;
+    curRow++;
+    if (palette && format == RGB)
+    {
+        pixels.insert(pixels.end(), *row, *row + (size_t)width * 3);
+        return true;
+    }
+    if (setjmp(png_jmpbuf(priv->png)))
+        return false;
+    png_write_row(priv->png, *row);
+    return true;
+}
+
+bool PngStreamWriter::close()
+{
+    if (priv == NULL)
+        return false;
+    if (palette && format == RGB && !writePalette())
+        return false;
+    if (setjmp(png_jmpbuf(priv->png)))
+        return false;
+    png_write_end(priv->png, priv->info);
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef __PNG_STREAM_WRITER
+#define __PNG_STREAM_WRITER
+#include <stdio.h>
+#include <vector>
+#include <cpp/poppler-version.h>
+#include <goo/ImgWriter.h>
+
+#ifndef IMG_WRITER_DPI
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 26
+#define IMG_WRITER_DPI int
+#else
+#define IMG_WRITER_DPI double
+#endif
+#endif
+
+struct PngStreamWriterPrivate;
+
+/**
+ * PNG image writer which talks to libpng directly.
+ *
+ * Unlike poppler's PNGWriter it exposes zlib compression level and
+ * strategy, the row filter and can write RGB images as indexed color
+ * with a palette of at most 256 entries. Palette images are buffered
+ * until close(), the palette is exact when the image has few colors
+ * (e.g. text pages) and median cut quantized otherwise.
+ */
+class PngStreamWriter : public ImgWriter
+{
+public:
+    enum Format
+    {
+        RGB,
+        GRAY,
+        MONOCHROME
+    };
+
+    enum Strategy
+    {
+        STRATEGY_AUTO,
+        STRATEGY_DEFAULT,
+        STRATEGY_FILTERED,
+        STRATEGY_HUFFMAN,
+        STRATEGY_RLE,
+        STRATEGY_FIXED
+    };
+
+    enum Filter
+    {
+        FILTER_AUTO,
+        FILTER_NONE,
+        FILTER_SUB,
+        FILTER_UP,
+        FILTER_AVERAGE,
+        FILTER_PAETH,
+        FILTER_ALL
+    };
+
+    PngStreamWriter(Format format = RGB);
+    ~PngStreamWriter();
+
+    void setCompressionLevel(int level);
+    void setStrategy(Strategy strategy);
+    void setFilter(Filter filter);
+    void setPalette(bool palette);
+
+    bool init(FILE *f, int width, int height, IMG_WRITER_DPI hDPI, IMG_WRITER_DPI vDPI) override;
+    bool writePointers(unsigned char **rowPointers, int rowCount) override;
+    bool writeRow(unsigned char **row) override;
+    bool close() override;
+
+private:
+    bool writeHeader(int colorType, int bitDepth);
+    bool writePalette();
+
+    PngStreamWriterPrivate *priv;
+    Format format;
+    int level;
+    Strategy strategy;
+    Filter filter;
+    bool palette;
+    int width;
+    int height;
+    double hDPI;
+    double vDPI;
+    std::vector<unsigned char> pixels;
+    int curRow;
+};
+#endif
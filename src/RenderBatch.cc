@@ -0,0 +1,224 @@
+#include "RenderBatch.h"
+
+using namespace v8;
+using Nan::To;
+
+namespace node
+{
+
+RenderBatch::RenderBatch(Local<v8::Object> docHandle, size_t parallelism)
+    : settings(NULL), callback(NULL), onPage(NULL), requests(parallelism), failed(NULL), queueFull(false), next(0), running(0)
+{
+    this->docHandle.Reset(docHandle);
+    uv_mutex_init(&mutex);
+}
+
+RenderBatch::~RenderBatch()
+{
+    for (size_t i = 0; i < works.size(); i++)
+    {
+        if (works[i] != NULL)
+            delete works[i];
+    }
+    if (settings != NULL)
+        delete settings;
+    if (callback != NULL)
+        delete callback;
+    if (onPage != NULL)
+        delete onPage;
+    docHandle.Reset();
+    results.Reset();
+    uv_mutex_destroy(&mutex);
+}
+
+/**
+     * Queues batch workers
+     */
+void RenderBatch::start()
+{
+    if (onPage == NULL)
+    {
+        results.Reset(Nan::New<v8::Array>(works.size()));
+    }
+    uv_async_init(uv_default_loop(), &async, Deliver);
+    async.data = this;
+    // pages are not dequeued on abort, workers skip them instead
+    if (settings != NULL && !settings->watchSignal(true, NULL))
+    {
+        finish();
+        return;
+    }
+    if (requests.size() > works.size())
+    {
+        requests.resize(works.size());
+    }
+    if (requests.empty())
+    {
+        finish();
+        return;
+    }
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        requests[i].data = this;
+        if (!RenderThreadPool::get()->queue(&requests[i], Work, After))
+        {
+            break;
+        }
+        running++;
+    }
+    if (running == 0)
+    {
+        queueFull = true;
+        finish();
+    }
+}
+
+void RenderBatch::Work(RenderTask *req)
+{
+    RenderBatch *batch = static_cast<RenderBatch *>(req->data);
+    while (true)
+    {
+        uv_mutex_lock(&batch->mutex);
+        if (batch->failed != NULL || batch->next >= batch->works.size())
+        {
+            uv_mutex_unlock(&batch->mutex);
+            break;
+        }
+        size_t idx = batch->next++;
+        uv_mutex_unlock(&batch->mutex);
+
+        NodePopplerPage::RenderWork *work = batch->works[idx];
+        work->openStream();
+        if (work->error == NULL && !work->checkCancelled())
+        {
+            NodePopplerPage::display(work);
+            work->closeStream();
+        }
+
+        uv_mutex_lock(&batch->mutex);
+        batch->completed.push_back(idx);
+        if (work->error != NULL && batch->onPage == NULL && batch->failed == NULL)
+        {
+            // no one to report this page to, so stop the batch
+            batch->failed = work;
+        }
+        uv_mutex_unlock(&batch->mutex);
+        uv_async_send(&batch->async);
+    }
+}
+
+void RenderBatch::After(RenderTask *req, int status)
+{
+    RenderBatch *batch = static_cast<RenderBatch *>(req->data);
+    batch->running--;
+    if (batch->running == 0)
+    {
+        batch->deliver();
+        batch->finish();
+    }
+}
+
+NAUV_WORK_CB(RenderBatch::Deliver)
+{
+    RenderBatch *batch = static_cast<RenderBatch *>(async->data);
+    batch->deliver();
+}
+
+void RenderBatch::Closed(uv_handle_t *handle)
+{
+    RenderBatch *batch = static_cast<RenderBatch *>(handle->data);
+    delete batch;
+}
+
+/**
+     * Passes finished pages to JS
+     */
+void RenderBatch::deliver()
+{
+    Nan::HandleScope scope;
+    std::vector<size_t> ready;
+
+    uv_mutex_lock(&mutex);
+    ready.swap(completed);
+    uv_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < ready.size(); i++)
+    {
+        size_t idx = ready[i];
+        NodePopplerPage::RenderWork *work = works[idx];
+        if (work == failed)
+        {
+            continue;
+        }
+        Local<Value> err = Nan::Null();
+        Local<Value> out = Nan::Undefined();
+        if (work->error)
+        {
+            err = work->errorValue();
+            To<v8::Object>(err).ToLocalChecked()->Set(Nan::New("page").ToLocalChecked(), Nan::New<Uint32>(work->pg->getNum()));
+        }
+        else
+        {
+            Local<v8::Object> result = work->bufferResult();
+            result->Set(Nan::New("page").ToLocalChecked(), Nan::New<Uint32>(work->pg->getNum()));
+            out = result;
+        }
+        if (onPage != NULL)
+        {
+            Local<Value> argv[] = {err, out};
+            Nan::TryCatch try_catch;
+            Nan::AsyncResource res(Nan::New("poppler-simple::render-pages").ToLocalChecked());
+            onPage->Call(2, argv, &res);
+            if (try_catch.HasCaught())
+            {
+                Nan::FatalException(try_catch);
+            }
+        }
+        else
+        {
+            Nan::New(results)->Set(idx, out);
+        }
+        delete work;
+        works[idx] = NULL;
+    }
+}
+
+/**
+     * Calls final callback and releases the batch
+     */
+void RenderBatch::finish()
+{
+    Nan::HandleScope scope;
+    Local<Value> argv[] = {Nan::Null(), Nan::Undefined()};
+    if (settings != NULL)
+    {
+        settings->unwatchSignal();
+    }
+    if (queueFull)
+    {
+        argv[0] = Nan::Error("Render queue is full");
+    }
+    else if (settings != NULL && settings->checkCancelled())
+    {
+        argv[0] = settings->errorValue();
+    }
+    else if (failed != NULL)
+    {
+        Local<Value> err = failed->errorValue();
+        To<v8::Object>(err).ToLocalChecked()->Set(Nan::New("page").ToLocalChecked(), Nan::New<Uint32>(failed->pg->getNum()));
+        argv[0] = err;
+    }
+    else if (onPage == NULL)
+    {
+        argv[1] = Nan::New(results);
+    }
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::render-pages").ToLocalChecked());
+    callback->Call(2, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
+    }
+    uv_close((uv_handle_t *)&async, Closed);
+}
+} // namespace node
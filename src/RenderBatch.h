@@ -0,0 +1,53 @@
+#ifndef __RENDER_BATCH
+#define __RENDER_BATCH
+#include <v8.h>
+#include <nan.h>
+#include <uv.h>
+#include <vector>
+
+#include "NodePopplerPage.h"
+
+namespace node
+{
+/**
+ * Renders a list of pages of one document to buffers.
+ *
+ * Pages are taken from a shared queue by `parallelism` render pool
+ * workers. Finished pages are passed back to the main thread through
+ * uv_async_t, so results are delivered as they are ready rather than
+ * one render pool round trip per page.
+ */
+class RenderBatch
+{
+  public:
+    RenderBatch(v8::Local<v8::Object> docHandle, size_t parallelism);
+    ~RenderBatch();
+
+    void start();
+
+    std::vector<NodePopplerPage::RenderWork *> works;
+    NodePopplerPage::RenderWork *settings;
+    Nan::Callback *callback;
+    Nan::Callback *onPage;
+
+  private:
+    static void Work(RenderTask *req);
+    static void After(RenderTask *req, int status);
+    static NAUV_WORK_CB(Deliver);
+    static void Closed(uv_handle_t *handle);
+    void deliver();
+    void finish();
+
+    Nan::Persistent<v8::Object> docHandle;
+    Nan::Persistent<v8::Array> results;
+    std::vector<RenderTask> requests;
+    std::vector<size_t> completed;
+    uv_async_t async;
+    uv_mutex_t mutex;
+    NodePopplerPage::RenderWork *failed;
+    bool queueFull;
+    size_t next;
+    size_t running;
+};
+} // namespace node
+#endif
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "RenderCache.h"
+
+using namespace v8;
+using Nan::To;
+
+namespace node
+{
+
+RenderCache *RenderCache::get()
+{
+    static RenderCache *cache = new RenderCache();
+    return cache;
+}
+
+RenderCache::RenderCache()
+    : bytes(0), maxBytes(0), hits(0), misses(0), evictions(0)
+{
+}
+
+/**
+     * Returns the entry for the key and marks it as recently used,
+     * NULL if there is none
+     */
+const RenderCache::Entry *RenderCache::lookup(const std::string &key)
+{
+    std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it = index.find(key);
+    if (it == index.end())
+    {
+        misses++;
+        return NULL;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return &*it->second;
+}
+
+/**
+     * Stores a copy of rendered data, evicting least recently used
+     * entries to stay within the budget
+     */
+void RenderCache::insert(const std::string &key, unsigned long docId,
+                         const char *data, size_t length,
+                         int width, int height, int stride)
+{
+    size_t size = length + key.size();
+    if (size > maxBytes || index.find(key) != index.end())
+    {
+        return;
+    }
+    char *copy = (char *)malloc(length > 0 ? length : 1);
+    if (copy == NULL)
+    {
+        return;
+    }
+    memcpy(copy, data, length);
+    evict(maxBytes - size);
+
+    Entry entry;
+    entry.key = key;
+    entry.docId = docId;
+    entry.data = copy;
+    entry.length = length;
+    entry.width = width;
+    entry.height = height;
+    entry.stride = stride;
+    entries.push_front(entry);
+    index[key] = entries.begin();
+    bytes += size;
+}
+
+void RenderCache::erase(std::list<Entry>::iterator it)
+{
+    bytes -= it->length + it->key.size();
+    free(it->data);
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+void RenderCache::evict(size_t budget)
+{
+    while (bytes > budget && !entries.empty())
+    {
+        erase(--entries.end());
+        evictions++;
+    }
+}
+
+/**
+     * Drops entries of a closed document, they can't be hit anymore
+     */
+void RenderCache::dropDocument(unsigned long docId)
+{
+    std::list<Entry>::iterator it = entries.begin();
+    while (it != entries.end())
+    {
+        std::list<Entry>::iterator next = it;
+        ++next;
+        if (it->docId == docId)
+        {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+void RenderCache::clear()
+{
+    while (!entries.empty())
+    {
+        erase(entries.begin());
+    }
+}
+
+/**
+     * Changes render cache settings
+     *
+     * Javascript function
+     *
+     * \param options Object with optional fields:
+     *   maxBytes: Integer - memory budget of the cache, 0 disables it
+     *
+     * \return Object \see RenderCache::getStats
+     */
+NAN_METHOD(RenderCache::configure)
+{
+    Nan::HandleScope scope;
+    RenderCache *cache = get();
+
+    if (info.Length() < 1 || !info[0]->IsObject())
+    {
+        return Nan::ThrowError("Arguments: (options: {maxBytes?: Number})");
+    }
+
+    Local<v8::Object> options = To<v8::Object>(info[0]).ToLocalChecked();
+    Local<String> mk = Nan::New("maxBytes").ToLocalChecked();
+    if (options->Has(mk))
+    {
+        Local<Value> mv = options->Get(mk);
+        if (!mv->IsNumber() || To<double>(mv).FromJust() < 0)
+        {
+            return Nan::ThrowError("'maxBytes' option value must be a non-negative number");
+        }
+        cache->maxBytes = (size_t)To<double>(mv).FromJust();
+        cache->evict(cache->maxBytes);
+    }
+
+    getStats(info);
+}
+
+/**
+     * \return Object Render cache state: bytes, maxBytes, entries and
+     *                hits, misses and evictions totals
+     */
+NAN_METHOD(RenderCache::getStats)
+{
+    Nan::HandleScope scope;
+    RenderCache *cache = get();
+    Local<v8::Object> stats = Nan::New<v8::Object>();
+    stats->Set(Nan::New("bytes").ToLocalChecked(), Nan::New<Number>(cache->bytes));
+    stats->Set(Nan::New("maxBytes").ToLocalChecked(), Nan::New<Number>(cache->maxBytes));
+    stats->Set(Nan::New("entries").ToLocalChecked(), Nan::New<Number>(cache->entries.size()));
+    stats->Set(Nan::New("hits").ToLocalChecked(), Nan::New<Number>(cache->hits));
+    stats->Set(Nan::New("misses").ToLocalChecked(), Nan::New<Number>(cache->misses));
+    stats->Set(Nan::New("evictions").ToLocalChecked(), Nan::New<Number>(cache->evictions));
+    info.GetReturnValue().Set(stats);
+}
+
+/**
+     * Drops all cached renders
+     *
+     * Javascript function
+     */
+NAN_METHOD(RenderCache::clearCache)
+{
+    get()->clear();
+}
+
+NAN_MODULE_INIT(RenderCache::Init)
+{
+    Nan::SetMethod(target, "configureRenderCache", RenderCache::configure);
+    Nan::SetMethod(target, "getRenderCacheStats", RenderCache::getStats);
+    Nan::SetMethod(target, "clearRenderCache", RenderCache::clearCache);
+}
+} // namespace node
@@ -0,0 +1,62 @@
+#ifndef __RENDER_CACHE
+#define __RENDER_CACHE
+#include <v8.h>
+#include <nan.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace node
+{
+/**
+ * LRU cache of rendered buffers with a byte budget.
+ *
+ * Keys describe everything the output depends on: document instance
+ * and its annotation generation, page, resolution, slice, format and
+ * encoder options. The cache is disabled until a budget is set with
+ * `configureRenderCache`. Used on the main thread only.
+ */
+class RenderCache
+{
+  public:
+    struct Entry
+    {
+        std::string key;
+        unsigned long docId;
+        char *data;
+        size_t length;
+        int width;
+        int height;
+        int stride;
+    };
+
+    static RenderCache *get();
+    static NAN_MODULE_INIT(Init);
+
+    bool isEnabled() { return maxBytes > 0; }
+    const Entry *lookup(const std::string &key);
+    void insert(const std::string &key, unsigned long docId,
+                const char *data, size_t length,
+                int width, int height, int stride);
+    void dropDocument(unsigned long docId);
+    void clear();
+
+  private:
+    RenderCache();
+
+    static NAN_METHOD(configure);
+    static NAN_METHOD(getStats);
+    static NAN_METHOD(clearCache);
+    void erase(std::list<Entry>::iterator it);
+    void evict(size_t budget);
+
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t bytes;
+    size_t maxBytes;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+} // namespace node
+#endif
@@ -0,0 +1,240 @@
+#include "RenderStream.h"
+
+using namespace v8;
+
+namespace node
+{
+
+Nan::Persistent<v8::Function> RenderStream::constructor;
+
+static void freeChunk(char *data, void *hint)
+{
+    free(data);
+}
+
+static SSIZE_TYPE render_stream_write(void *cookie, const char *buf, SIZE_TYPE size)
+{
+    return ((RenderStream *)cookie)->write(buf, size);
+}
+
+static int render_stream_close(void *cookie)
+{
+    return 0;
+}
+
+NAN_MODULE_INIT(RenderStream::Init)
+{
+    Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(RenderStream::New);
+    tpl->SetClassName(Nan::New<String>("PopplerRenderStream").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(tpl, "resume", RenderStream::resume);
+    Nan::SetPrototypeMethod(tpl, "cancel", RenderStream::cancel);
+
+    constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+RenderStream::RenderStream()
+    : onChunk(NULL), queued(0), highWaterMark(0), paused(false), cancelled(false)
+{
+    uv_mutex_init(&mutex);
+    uv_cond_init(&cond);
+    async = new uv_async_t;
+    uv_async_init(uv_default_loop(), async, Deliver);
+    async->data = this;
+}
+
+RenderStream::~RenderStream()
+{
+    close();
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        free(chunks[i].data);
+    }
+    if (onChunk != NULL)
+        delete onChunk;
+    uv_mutex_destroy(&mutex);
+    uv_cond_destroy(&cond);
+}
+
+NAN_METHOD(RenderStream::New)
+{
+    Nan::HandleScope scope;
+    RenderStream *self = new RenderStream();
+    self->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+}
+
+RenderStream *RenderStream::NewInstance(Nan::Callback *onChunk, size_t highWaterMark)
+{
+    Local<v8::Object> obj = Nan::NewInstance(Nan::New(constructor)).ToLocalChecked();
+    RenderStream *self = Nan::ObjectWrap::Unwrap<RenderStream>(obj);
+    self->onChunk = onChunk;
+    self->highWaterMark = highWaterMark;
+    return self;
+}
+
+FILE *RenderStream::open()
+{
+    FILE *f;
+#ifdef __linux
+    cookie_io_functions_t funcs = {NULL, render_stream_write, NULL, render_stream_close};
+    f = fopencookie((void *)this, "wb", funcs);
+#elif __APPLE__
+    f = funopen((void *)this, NULL, render_stream_write, NULL, render_stream_close);
+#endif
+    if (f != NULL)
+    {
+        // hand chunks of a reasonable size to Javascript
+        setvbuf(f, NULL, _IOFBF, 65536);
+    }
+    return f;
+}
+
+/**
+     * Queues encoder output, called on a render thread
+     */
+SSIZE_TYPE RenderStream::write(const char *buf, SIZE_TYPE size)
+{
+    uv_mutex_lock(&mutex);
+    while (paused && !cancelled && queued >= highWaterMark)
+    {
+        uv_cond_wait(&cond, &mutex);
+    }
+    if (!cancelled)
+    {
+        Chunk chunk;
+        chunk.data = (char *)malloc(size);
+        if (chunk.data == NULL)
+        {
+            uv_mutex_unlock(&mutex);
+            return -1;
+        }
+        memcpy(chunk.data, buf, size);
+        chunk.length = size;
+        chunks.push_back(chunk);
+        queued += size;
+    }
+    uv_mutex_unlock(&mutex);
+    uv_async_send(async);
+    return size;
+}
+
+bool RenderStream::isCancelled()
+{
+    uv_mutex_lock(&mutex);
+    bool c = cancelled;
+    uv_mutex_unlock(&mutex);
+    return c;
+}
+
+NAUV_WORK_CB(RenderStream::Deliver)
+{
+    RenderStream *self = static_cast<RenderStream *>(async->data);
+    self->deliver(false);
+}
+
+/**
+     * Passes queued chunks to `onChunk` until it asks to pause
+     */
+void RenderStream::deliver(bool force)
+{
+    Nan::HandleScope scope;
+    while (true)
+    {
+        uv_mutex_lock(&mutex);
+        if (chunks.empty() || cancelled || (paused && !force))
+        {
+            uv_mutex_unlock(&mutex);
+            return;
+        }
+        Chunk chunk = chunks.front();
+        chunks.pop_front();
+        queued -= chunk.length;
+        uv_cond_signal(&cond);
+        uv_mutex_unlock(&mutex);
+
+        Local<Value> argv[] = {Nan::NewBuffer(chunk.data, chunk.length, freeChunk, NULL).ToLocalChecked()};
+        Nan::TryCatch try_catch;
+        Nan::AsyncResource res(Nan::New("poppler-simple::render-stream").ToLocalChecked());
+        Nan::MaybeLocal<Value> ret = onChunk->Call(1, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+        if (!ret.IsEmpty() && ret.ToLocalChecked()->IsFalse())
+        {
+            uv_mutex_lock(&mutex);
+            paused = true;
+            uv_mutex_unlock(&mutex);
+        }
+    }
+}
+
+/**
+     * Passes all remaining chunks to `onChunk`, called after encoding
+     */
+void RenderStream::drain()
+{
+    deliver(true);
+}
+
+/**
+     * Stops delivery, the stream can't be used afterwards
+     */
+void RenderStream::close()
+{
+    if (async != NULL)
+    {
+        uv_close((uv_handle_t *)async, Closed);
+        async = NULL;
+    }
+}
+
+void RenderStream::Closed(uv_handle_t *handle)
+{
+    delete (uv_async_t *)handle;
+}
+
+/**
+     * Resumes delivery of chunks after `onChunk` returned false
+     *
+     * Javascript function
+     */
+NAN_METHOD(RenderStream::resume)
+{
+    Nan::HandleScope scope;
+    RenderStream *self = Nan::ObjectWrap::Unwrap<RenderStream>(info.Holder());
+    uv_mutex_lock(&self->mutex);
+    self->paused = false;
+    uv_cond_signal(&self->cond);
+    uv_mutex_unlock(&self->mutex);
+    if (self->async != NULL)
+    {
+        uv_async_send(self->async);
+    }
+}
+
+/**
+     * Drops the rest of the output. Render finishes with an error.
+     *
+     * Javascript function
+     */
+NAN_METHOD(RenderStream::cancel)
+{
+    Nan::HandleScope scope;
+    RenderStream *self = Nan::ObjectWrap::Unwrap<RenderStream>(info.Holder());
+    self->abort();
+}
+
+/**
+     * Drops the rest of the output and releases a waiting encoder
+     */
+void RenderStream::abort()
+{
+    uv_mutex_lock(&mutex);
+    cancelled = true;
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+}
+} // namespace node
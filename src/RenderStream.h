@@ -0,0 +1,65 @@
+#ifndef __RENDER_STREAM
+#define __RENDER_STREAM
+#include <v8.h>
+#include <nan.h>
+#include <uv.h>
+#include <deque>
+
+#include "MemoryStream.h"
+
+namespace node
+{
+/**
+ * Forwards encoder output from a render thread to Javascript.
+ *
+ * Exposed to the encoder as a write-only FILE*. Written chunks are
+ * queued and passed to `onChunk` on the main thread. If `onChunk`
+ * returns false, delivery pauses until `resume()`, and the encoder
+ * blocks once `highWaterMark` bytes are queued. After `cancel()` the
+ * rest of the output is dropped, so the render thread is released.
+ */
+class RenderStream : public Nan::ObjectWrap
+{
+  public:
+    static NAN_MODULE_INIT(Init);
+    static RenderStream *NewInstance(Nan::Callback *onChunk, size_t highWaterMark);
+
+    FILE *open();
+    void drain();
+    void close();
+    void abort();
+    bool isCancelled();
+
+    SSIZE_TYPE write(const char *buf, SIZE_TYPE size);
+
+  private:
+    struct Chunk
+    {
+        char *data;
+        size_t length;
+    };
+
+    RenderStream();
+    ~RenderStream();
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(resume);
+    static NAN_METHOD(cancel);
+    static NAUV_WORK_CB(Deliver);
+    static void Closed(uv_handle_t *handle);
+    void deliver(bool force);
+
+    static Nan::Persistent<v8::Function> constructor;
+
+    Nan::Callback *onChunk;
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    uv_async_t *async;
+    std::deque<Chunk> chunks;
+    size_t queued;
+    size_t highWaterMark;
+    bool paused;
+    bool cancelled;
+};
+} // namespace node
+#endif
@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <algorithm>
+
+#include "RenderThreadPool.h"
+
+using namespace v8;
+using Nan::To;
+
+namespace node
+{
+
+/**
+ * Initial number of render threads, POPPLER_RENDER_THREADS or the
+ * number of CPUs
+ */
+static size_t defaultThreadCount()
+{
+    const char *val = getenv("POPPLER_RENDER_THREADS");
+    int count = val != NULL ? atoi(val) : 0;
+    if (count > 0)
+    {
+        return count;
+    }
+    uv_cpu_info_t *cpus;
+    if (uv_cpu_info(&cpus, &count) == 0)
+    {
+        uv_free_cpu_info(cpus, count);
+    }
+    return count > 0 ? count : 4;
+}
+
+RenderThreadPool *RenderThreadPool::get()
+{
+    // created on the main thread by Init
+    static RenderThreadPool *pool = new RenderThreadPool(defaultThreadCount());
+    return pool;
+}
+
+RenderThreadPool::RenderThreadPool(size_t threads)
+    : targetThreads(0), liveThreads(0), maxQueueDepth(0), active(0), inFlight(0), completed(0), rejected(0), cancelled(0)
+{
+    uv_mutex_init(&mutex);
+    uv_cond_init(&cond);
+    uv_async_init(uv_default_loop(), &async, Done);
+    async.data = this;
+    // don't keep the event loop alive while there is nothing to render
+    uv_unref((uv_handle_t *)&async);
+    resize(threads);
+}
+
+/**
+ * Queues a task. Returns false if the queue is full.
+ *
+ * Must be called on the main thread.
+ */
+bool RenderThreadPool::queue(RenderTask *task,
+                             void (*work)(RenderTask *task),
+                             void (*after)(RenderTask *task, int status))
+{
+    task->work = work;
+    task->after = after;
+    task->status = 0;
+    uv_mutex_lock(&mutex);
+    if (maxQueueDepth > 0 && pending.size() >= maxQueueDepth)
+    {
+        rejected++;
+        uv_mutex_unlock(&mutex);
+        return false;
+    }
+    pending.push_back(task);
+    uv_cond_signal(&cond);
+    uv_mutex_unlock(&mutex);
+
+    if (inFlight++ == 0)
+    {
+        uv_ref((uv_handle_t *)&async);
+    }
+    return true;
+}
+
+/**
+ * Calls `after` on the next loop iteration without running any work,
+ * for results available right away
+ *
+ * Must be called on the main thread.
+ */
+void RenderThreadPool::complete(RenderTask *task, void (*after)(RenderTask *task, int status))
+{
+    task->work = NULL;
+    task->after = after;
+    task->status = 0;
+    uv_mutex_lock(&mutex);
+    done.push_back(task);
+    uv_mutex_unlock(&mutex);
+
+    if (inFlight++ == 0)
+    {
+        uv_ref((uv_handle_t *)&async);
+    }
+    uv_async_send(&async);
+}
+
+/**
+ * Takes a task off the queue if no thread has picked it up yet. Its
+ * `after` is then called with UV_ECANCELED status, like for uv_cancel.
+ * Returns false if the task is running or already done.
+ *
+ * Must be called on the main thread.
+ */
+bool RenderThreadPool::cancel(RenderTask *task)
+{
+    uv_mutex_lock(&mutex);
+    std::deque<RenderTask *>::iterator it = std::find(pending.begin(), pending.end(), task);
+    bool found = it != pending.end();
+    if (found)
+    {
+        pending.erase(it);
+        task->status = UV_ECANCELED;
+        cancelled++;
+        done.push_back(task);
+    }
+    uv_mutex_unlock(&mutex);
+
+    if (found)
+    {
+        uv_async_send(&async);
+    }
+    return found;
+}
+
+/**
+ * Starts new threads or lets extra ones exit once they are idle
+ */
+void RenderThreadPool::resize(size_t threads)
+{
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+    uv_mutex_lock(&mutex);
+    targetThreads = threads;
+    size_t toStart = threads > liveThreads ? threads - liveThreads : 0;
+    liveThreads += toStart;
+    uv_cond_broadcast(&cond);
+    uv_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < toStart; i++)
+    {
+        Worker *worker = new Worker();
+        worker->pool = this;
+        worker->exited = false;
+        if (uv_thread_create(&worker->thread, WorkerMain, worker) != 0)
+        {
+            delete worker;
+            uv_mutex_lock(&mutex);
+            liveThreads--;
+            uv_mutex_unlock(&mutex);
+            continue;
+        }
+        workers.push_back(worker);
+    }
+    reap();
+}
+
+void RenderThreadPool::setMaxQueueDepth(size_t depth)
+{
+    uv_mutex_lock(&mutex);
+    maxQueueDepth = depth;
+    uv_mutex_unlock(&mutex);
+}
+
+size_t RenderThreadPool::getThreadCount()
+{
+    uv_mutex_lock(&mutex);
+    size_t count = targetThreads;
+    uv_mutex_unlock(&mutex);
+    return count;
+}
+
+void RenderThreadPool::WorkerMain(void *arg)
+{
+    Worker *self = (Worker *)arg;
+    RenderThreadPool *pool = self->pool;
+
+    uv_mutex_lock(&pool->mutex);
+    while (true)
+    {
+        while (pool->pending.empty() && pool->liveThreads <= pool->targetThreads)
+        {
+            uv_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->liveThreads > pool->targetThreads)
+        {
+            pool->liveThreads--;
+            self->exited = true;
+            break;
+        }
+        RenderTask *task = pool->pending.front();
+        pool->pending.pop_front();
+        pool->active++;
+        uv_mutex_unlock(&pool->mutex);
+
+        task->work(task);
+
+        uv_mutex_lock(&pool->mutex);
+        pool->active--;
+        pool->completed++;
+        pool->done.push_back(task);
+        uv_async_send(&pool->async);
+    }
+    uv_mutex_unlock(&pool->mutex);
+    // let the main thread join this one
+    uv_async_send(&pool->async);
+}
+
+/**
+ * Joins threads exited after shrinking the pool
+ */
+void RenderThreadPool::reap()
+{
+    for (size_t i = workers.size(); i > 0; i--)
+    {
+        Worker *worker = workers[i - 1];
+        uv_mutex_lock(&mutex);
+        bool exited = worker->exited;
+        uv_mutex_unlock(&mutex);
+        if (exited)
+        {
+            uv_thread_join(&worker->thread);
+            delete worker;
+            workers.erase(workers.begin() + (i - 1));
+        }
+    }
+}
+
+NAUV_WORK_CB(RenderThreadPool::Done)
+{
+    RenderThreadPool *pool = static_cast<RenderThreadPool *>(async->data);
+    std::deque<RenderTask *> finished;
+
+    uv_mutex_lock(&pool->mutex);
+    finished.swap(pool->done);
+    uv_mutex_unlock(&pool->mutex);
+
+    pool->reap();
+    for (size_t i = 0; i < finished.size(); i++)
+    {
+        pool->inFlight--;
+        finished[i]->after(finished[i], finished[i]->status);
+    }
+    if (pool->inFlight == 0)
+    {
+        uv_unref((uv_handle_t *)&pool->async);
+    }
+}
+
+/**
+     * Changes render pool settings
+     *
+     * Javascript function
+     *
+     * \param options Object with optional fields:
+     *   threads: Integer - number of render threads
+     *   maxQueueDepth: Integer - maximum number of renders waiting for
+     *              a thread, 0 for unlimited. Renders over the limit
+     *              fail with 'Render queue is full' error.
+     *
+     * \return Object \see RenderThreadPool::getStats
+     */
+NAN_METHOD(RenderThreadPool::configure)
+{
+    Nan::HandleScope scope;
+    RenderThreadPool *pool = get();
+
+    if (info.Length() < 1 || !info[0]->IsObject())
+    {
+        return Nan::ThrowError("Arguments: (options: {threads?: Number, maxQueueDepth?: Number})");
+    }
+
+    Local<v8::Object> options = To<v8::Object>(info[0]).ToLocalChecked();
+    Local<String> tk = Nan::New("threads").ToLocalChecked();
+    Local<String> qk = Nan::New("maxQueueDepth").ToLocalChecked();
+    // all options are validated before any is applied
+    bool hasThreads = options->Has(tk);
+    bool hasQueueDepth = options->Has(qk);
+    Local<Value> tv = hasThreads ? options->Get(tk) : Local<Value>(Nan::Undefined());
+    Local<Value> qv = hasQueueDepth ? options->Get(qk) : Local<Value>(Nan::Undefined());
+    if (hasThreads && (!tv->IsUint32() || To<uint32_t>(tv).FromJust() == 0))
+    {
+        return Nan::ThrowError("'threads' option value must be a positive integer");
+    }
+    if (hasQueueDepth && !qv->IsUint32())
+    {
+        return Nan::ThrowError("'maxQueueDepth' option value must be a non-negative integer");
+    }
+    if (hasThreads)
+    {
+        pool->resize(To<uint32_t>(tv).FromJust());
+    }
+    if (hasQueueDepth)
+    {
+        pool->setMaxQueueDepth(To<uint32_t>(qv).FromJust());
+    }
+
+    getStats(info);
+}
+
+/**
+     * \return Object Render pool state: threads, maxQueueDepth, active
+     *                and queued renders, completed, rejected and
+     *                cancelled totals
+     */
+NAN_METHOD(RenderThreadPool::getStats)
+{
+    Nan::HandleScope scope;
+    RenderThreadPool *pool = get();
+    Local<v8::Object> stats = Nan::New<v8::Object>();
+
+    uv_mutex_lock(&pool->mutex);
+    stats->Set(Nan::New("threads").ToLocalChecked(), Nan::New<Number>(pool->targetThreads));
+    stats->Set(Nan::New("maxQueueDepth").ToLocalChecked(), Nan::New<Number>(pool->maxQueueDepth));
+    stats->Set(Nan::New("active").ToLocalChecked(), Nan::New<Number>(pool->active));
+    stats->Set(Nan::New("queued").ToLocalChecked(), Nan::New<Number>(pool->pending.size()));
+    stats->Set(Nan::New("completed").ToLocalChecked(), Nan::New<Number>(pool->completed));
+    stats->Set(Nan::New("rejected").ToLocalChecked(), Nan::New<Number>(pool->rejected));
+    stats->Set(Nan::New("cancelled").ToLocalChecked(), Nan::New<Number>(pool->cancelled));
+    uv_mutex_unlock(&pool->mutex);
+
+    info.GetReturnValue().Set(stats);
+}
+
+NAN_MODULE_INIT(RenderThreadPool::Init)
+{
+    get();
+    Nan::SetMethod(target, "configureRenderPool", RenderThreadPool::configure);
+    Nan::SetMethod(target, "getRenderPoolStats", RenderThreadPool::getStats);
+}
+} // namespace node
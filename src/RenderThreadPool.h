@@ -0,0 +1,79 @@
+#ifndef __RENDER_THREAD_POOL
+#define __RENDER_THREAD_POOL
+#include <v8.h>
+#include <nan.h>
+#include <uv.h>
+#include <deque>
+#include <vector>
+
+namespace node
+{
+class RenderThreadPool;
+
+/**
+ * Unit of work for RenderThreadPool, analogous to uv_work_t
+ */
+struct RenderTask
+{
+    void *data;
+    void (*work)(RenderTask *task);
+    void (*after)(RenderTask *task, int status);
+    int status;
+};
+
+/**
+ * Worker threads dedicated to rendering.
+ *
+ * Rasterization may take seconds, so running it on the default libuv
+ * threadpool starves fs, dns and zlib requests of the process. Tasks
+ * are run on a separate set of threads, and their `after` callbacks
+ * are called on the main loop, like with uv_queue_work.
+ */
+class RenderThreadPool
+{
+  public:
+    static RenderThreadPool *get();
+    static NAN_MODULE_INIT(Init);
+
+    bool queue(RenderTask *task,
+               void (*work)(RenderTask *task),
+               void (*after)(RenderTask *task, int status));
+    void complete(RenderTask *task, void (*after)(RenderTask *task, int status));
+    bool cancel(RenderTask *task);
+    void resize(size_t threads);
+    void setMaxQueueDepth(size_t depth);
+    size_t getThreadCount();
+
+  private:
+    struct Worker
+    {
+        RenderThreadPool *pool;
+        uv_thread_t thread;
+        bool exited;
+    };
+
+    RenderThreadPool(size_t threads);
+
+    static void WorkerMain(void *arg);
+    static NAUV_WORK_CB(Done);
+    static NAN_METHOD(configure);
+    static NAN_METHOD(getStats);
+    void reap();
+
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    uv_async_t async;
+    std::deque<RenderTask *> pending;
+    std::deque<RenderTask *> done;
+    std::vector<Worker *> workers;
+    size_t targetThreads;
+    size_t liveThreads;
+    size_t maxQueueDepth;
+    size_t active;
+    size_t inFlight;
+    unsigned long completed;
+    unsigned long rejected;
+    unsigned long cancelled;
+};
+} // namespace node
+#endif
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+
+#include "RendererPool.h"
+
+RendererPool::Renderer::~Renderer()
+{
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        delete devices[i].dev;
+    }
+    delete doc;
+}
+
+/**
+ * Returns renderer's output device with given settings, creating
+ * it on first use
+ */
+DraftOutputDev *RendererPool::Renderer::getOutputDev(const DeviceSettings &settings)
+{
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        if (devices[i].settings == settings)
+        {
+            return devices[i].dev;
+        }
+    }
+    SplashColor paperColor;
+    paperColor[0] = 255;
+    paperColor[1] = 255;
+    paperColor[2] = 255;
+    Entry entry = {new DraftOutputDev(settings.mode, 4, false, paperColor), settings};
+    // font settings are applied to the font engine created by startDoc
+    entry.dev->setVectorAntialias(settings.vectorAntialias);
+    entry.dev->setFontAntialias(settings.textAntialias);
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 22
+    entry.dev->setFreeTypeHinting(settings.hinting != HINTING_NONE);
+#else
+    entry.dev->setFreeTypeHinting(settings.hinting != HINTING_NONE, settings.hinting == HINTING_SLIGHT);
+#endif
+#if POPPLER_VERSION_MAJOR > 0 || POPPLER_VERSION_MINOR >= 24
+    entry.dev->setThinLineMode((SplashThinLineMode)settings.thinLineMode);
+#endif
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 19
+    entry.dev->startDoc(doc->getXRef());
+#else
+    entry.dev->startDoc(doc);
+#endif
+    devices.push_back(entry);
+    return entry.dev;
+}
+
+/**
+ * Number of threads rendering concurrently, i.e. render thread pool size
+ */
+size_t RendererPool::getCapacity()
+{
+    return RenderThreadPool::get()->getThreadCount();
+}
+
+RendererPool::RendererPool(DocOpener opener, void *openerData)
+    : opener(opener), openerData(openerData), generation(0)
+{
+    uv_mutex_init(&mutex);
+}
+
+RendererPool::~RendererPool()
+{
+    for (size_t i = 0; i < idle.size(); i++)
+    {
+        delete idle[i];
+    }
+    uv_mutex_destroy(&mutex);
+}
+
+/**
+ * Takes an idle renderer of the current generation or opens a new one.
+ * Returns NULL if the document can't be opened again.
+ */
+RendererPool::Renderer *RendererPool::acquire()
+{
+    Renderer *renderer = NULL;
+    std::vector<Renderer *> stale;
+    uv_mutex_lock(&mutex);
+    while (renderer == NULL && !idle.empty())
+    {
+        renderer = idle.back();
+        idle.pop_back();
+        if (renderer->generation != generation)
+        {
+            stale.push_back(renderer);
+            renderer = NULL;
+        }
+    }
+    uv_mutex_unlock(&mutex);
+    for (size_t i = 0; i < stale.size(); i++)
+    {
+        delete stale[i];
+    }
+
+    if (renderer == NULL)
+    {
+        unsigned long docGeneration = 0;
+        PDFDoc *doc = opener(openerData, &docGeneration);
+        if (doc == NULL || !doc->isOk())
+        {
+            delete doc;
+            return NULL;
+        }
+        renderer = new Renderer(doc, docGeneration);
+    }
+    return renderer;
+}
+
+/**
+ * Returns a renderer to the pool, dropping it if the document changed
+ * since it was opened, or the oldest idle one when the pool is full
+ */
+void RendererPool::release(Renderer *renderer)
+{
+    Renderer *evicted = NULL;
+    uv_mutex_lock(&mutex);
+    if (renderer->generation != generation)
+    {
+        evicted = renderer;
+    }
+    else
+    {
+        idle.push_back(renderer);
+        if (idle.size() > getCapacity())
+        {
+            evicted = idle.front();
+            idle.erase(idle.begin());
+        }
+    }
+    uv_mutex_unlock(&mutex);
+
+    if (evicted != NULL)
+    {
+        delete evicted;
+    }
+}
+
+/**
+ * Called on the main thread after an annotation change, idle renderers
+ * of older generations are dropped as they are met
+ */
+void RendererPool::setGeneration(unsigned long generation)
+{
+    uv_mutex_lock(&mutex);
+    this->generation = generation;
+    uv_mutex_unlock(&mutex);
+}
@@ -0,0 +1,98 @@
+#ifndef __RENDERER_POOL
+#define __RENDERER_POOL
+#include <uv.h>
+#include <vector>
+#include <cpp/poppler-version.h>
+#include <poppler/PDFDoc.h>
+#include <poppler/SplashOutputDev.h>
+
+#include "RenderThreadPool.h"
+#include "DraftOutputDev.h"
+
+/**
+ * Pool of renderers of a document.
+ *
+ * PDFDoc (with its XRef, Catalog and Page objects) is not safe to use
+ * from several threads at once, so every renderer owns an independent
+ * PDFDoc instance opened over the same file or buffer. The document
+ * used by the main thread is never handed to renders. Renderers also
+ * keep warmed up output devices, so repeated renders reuse font engine
+ * and glyph caches. The pool keeps at most one idle renderer per
+ * render thread.
+ *
+ * Instances are opened with the annotation changes made so far
+ * replayed on them. Each change bumps the document generation, and
+ * renderers of older generations are dropped instead of reused.
+ */
+class RendererPool
+{
+  public:
+    // opens a document instance and tells the generation it reflects
+    typedef PDFDoc *(*DocOpener)(void *data, unsigned long *generation);
+
+    enum Hinting
+    {
+        HINTING_NONE,
+        HINTING_SLIGHT,
+        HINTING_FULL
+    };
+
+    /**
+     * Output device settings, devices are kept per distinct settings
+     */
+    struct DeviceSettings
+    {
+        SplashColorMode mode;
+        bool vectorAntialias;
+        bool textAntialias;
+        // SplashThinLineMode
+        int thinLineMode;
+        Hinting hinting;
+
+        bool operator==(const DeviceSettings &other) const
+        {
+            return mode == other.mode &&
+                   vectorAntialias == other.vectorAntialias &&
+                   textAntialias == other.textAntialias &&
+                   thinLineMode == other.thinLineMode &&
+                   hinting == other.hinting;
+        }
+    };
+
+    class Renderer
+    {
+      public:
+        Renderer(PDFDoc *doc, unsigned long generation) : doc(doc), generation(generation) {}
+        ~Renderer();
+
+        DraftOutputDev *getOutputDev(const DeviceSettings &settings);
+
+        PDFDoc *doc;
+        unsigned long generation;
+
+      private:
+        struct Entry
+        {
+            DraftOutputDev *dev;
+            DeviceSettings settings;
+        };
+        std::vector<Entry> devices;
+    };
+
+    RendererPool(DocOpener opener, void *openerData);
+    ~RendererPool();
+
+    static size_t getCapacity();
+
+    Renderer *acquire();
+    void release(Renderer *renderer);
+    void setGeneration(unsigned long generation);
+
+  private:
+    DocOpener opener;
+    void *openerData;
+    uv_mutex_t mutex;
+    std::vector<Renderer *> idle;
+    unsigned long generation;
+};
+#endif
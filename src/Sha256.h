@@ -0,0 +1,26 @@
+#ifndef __SHA256
+#define __SHA256
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * SHA-256 digest (FIPS 180-4), used to address disk cache entries.
+ */
+class Sha256
+{
+  public:
+    Sha256();
+
+    void update(const void *data, size_t length);
+    std::string hexDigest();
+
+  private:
+    void transform(const unsigned char *block);
+
+    uint32_t state[8];
+    uint64_t bitLength;
+    unsigned char buffer[64];
+    size_t bufferLength;
+};
+#endif
@@ -0,0 +1,167 @@
+#include <string.h>
+#include <sys/types.h>
+#include <tiffio.h>
+
+#include "TiffStreamWriter.h"
+
+static const struct
+{
+    const char *name;
+    int compression;
+} compressionList[] = {
+    {"none", COMPRESSION_NONE},
+    {"ccittrle", COMPRESSION_CCITTRLE},
+    {"ccittfax3", COMPRESSION_CCITTFAX3},
+    {"ccittt4", COMPRESSION_CCITT_T4},
+    {"ccittfax4", COMPRESSION_CCITTFAX4},
+    {"ccittt6", COMPRESSION_CCITT_T6},
+    {"lzw", COMPRESSION_LZW},
+    {"ojpeg", COMPRESSION_OJPEG},
+    {"jpeg", COMPRESSION_JPEG},
+    {"next", COMPRESSION_NEXT},
+    {"packbits", COMPRESSION_PACKBITS},
+    {"ccittrlew", COMPRESSION_CCITTRLEW},
+    {"deflate", COMPRESSION_DEFLATE},
+    {"adeflate", COMPRESSION_ADOBE_DEFLATE},
+    {"dcs", COMPRESSION_DCS},
+    {"jbig", COMPRESSION_JBIG},
+    {"jp2000", COMPRESSION_JP2000},
+    {NULL, 0}};
+
+static int findCompression(const char *compressionStr)
+{
+    if (compressionStr == NULL)
+        return COMPRESSION_NONE;
+    for (int i = 0; compressionList[i].name != NULL; i++)
+    {
+        if (strcmp(compressionStr, compressionList[i].name) == 0)
+            return compressionList[i].compression;
+    }
+    return -1;
+}
+
+extern "C" {
+static tsize_t tiffReadProc(thandle_t handle, tdata_t data, tsize_t size)
+{
+    return fread(data, 1, size, (FILE *)handle);
+}
+
+static tsize_t tiffWriteProc(thandle_t handle, tdata_t data, tsize_t size)
+{
+    return fwrite(data, 1, size, (FILE *)handle);
+}
+
+static toff_t tiffSeekProc(thandle_t handle, toff_t offset, int whence)
+{
+    FILE *f = (FILE *)handle;
+    if (fseeko(f, (off_t)offset, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftello(f);
+}
+
+static int tiffCloseProc(thandle_t handle)
+{
+    // the FILE* is owned and closed by the caller
+    return 0;
+}
+
+static toff_t tiffSizeProc(thandle_t handle)
+{
+    FILE *f = (FILE *)handle;
+    off_t pos = ftello(f);
+    fseeko(f, 0, SEEK_END);
+    off_t size = ftello(f);
+    fseeko(f, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static int tiffMapProc(thandle_t handle, tdata_t *data, toff_t *size)
+{
+    return 0;
+}
+
+static void tiffUnmapProc(thandle_t handle, tdata_t data, toff_t size)
+{
+}
+}
+
+TiffStreamWriter::TiffStreamWriter(Format format)
+    : tif(NULL), format(format), compressionString(NULL), curRow(0)
+{
+}
+
+TiffStreamWriter::~TiffStreamWriter()
+{
+    if (tif)
+        TIFFClose(tif);
+}
+
+bool TiffStreamWriter::isCompressionSupported(const char *compressionStr)
+{
+    return findCompression(compressionStr) != -1;
+}
+
+void TiffStreamWriter::setCompressionString(const char *compressionStr)
+{
+    compressionString = compressionStr;
+}
+
+bool TiffStreamWriter::init(FILE *f, int width, int height, IMG_WRITER_DPI hDPI, IMG_WRITER_DPI vDPI)
+{
+    int compression = findCompression(compressionString);
+    if (f == NULL || compression == -1)
+        return false;
+
+    tif = TIFFClientOpen("-", "w", (thandle_t)f,
+                         tiffReadProc, tiffWriteProc, tiffSeekProc,
+                         tiffCloseProc, tiffSizeProc,
+                         tiffMapProc, tiffUnmapProc);
+    if (tif == NULL)
+        return false;
+
+    int samplesPerPixel = format == RGB ? 3 : 1;
+    int bitsPerSample = format == MONOCHROME ? 1 : 8;
+    int photometric = format == RGB ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK;
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)height);
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, samplesPerPixel);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitsPerSample);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, photometric);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, (uint32_t)-1));
+    TIFFSetField(tif, TIFFTAG_XRESOLUTION, (double)hDPI);
+    TIFFSetField(tif, TIFFTAG_YRESOLUTION, (double)vDPI);
+    TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+    curRow = 0;
+    return true;
+}
+
+bool TiffStreamWriter::writePointers(unsigned char **rowPointers, int rowCount)
+{
+    for (int i = 0; i < rowCount; i++)
+    {
+        if (!writeRow(&rowPointers[i]))
+            return false;
+    }
+    return true;
+}
+
+bool TiffStreamWriter::writeRow(unsigned char **row)
+{
+    if (TIFFWriteScanline(tif, *row, curRow, 0) < 0)
+        return false;
+    curRow++;
+    return true;
+}
+
+bool TiffStreamWriter::close()
+{
+    if (tif == NULL)
+        return false;
+    TIFFClose(tif);
+    tif = NULL;
+    return true;
+}
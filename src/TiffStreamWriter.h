@@ -0,0 +1,51 @@
+#ifndef __TIFF_STREAM_WRITER
+#define __TIFF_STREAM_WRITER
+#include <stdio.h>
+#include <cpp/poppler-version.h>
+#include <goo/ImgWriter.h>
+
+#ifndef IMG_WRITER_DPI
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 26
+#define IMG_WRITER_DPI int
+#else
+#define IMG_WRITER_DPI double
+#endif
+#endif
+
+struct tiff;
+
+/**
+ * TIFF image writer which talks to libtiff through stdio calls
+ * on the output FILE*.
+ *
+ * Poppler's TiffWriter hands the file descriptor to libtiff, so it
+ * can't write into streams without one (e.g. MemoryStream).
+ */
+class TiffStreamWriter : public ImgWriter
+{
+public:
+    enum Format
+    {
+        RGB,
+        GRAY,
+        MONOCHROME
+    };
+
+    TiffStreamWriter(Format format = RGB);
+    ~TiffStreamWriter();
+
+    static bool isCompressionSupported(const char *compressionStr);
+    void setCompressionString(const char *compressionStr);
+
+    bool init(FILE *f, int width, int height, IMG_WRITER_DPI hDPI, IMG_WRITER_DPI vDPI) override;
+    bool writePointers(unsigned char **rowPointers, int rowCount) override;
+    bool writeRow(unsigned char **row) override;
+    bool close() override;
+
+private:
+    struct tiff *tif;
+    Format format;
+    const char *compressionString;
+    int curRow;
+};
+#endif
@@ -0,0 +1,385 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "TileRender.h"
+#include "NodePopplerDocument.h"
+
+using namespace v8;
+using Nan::To;
+
+namespace node
+{
+
+static void freeTileBuffer(char *data, void *hint)
+{
+    free(data);
+}
+
+TileRender::TileRender(NodePopplerPage::RenderWork *settings)
+    : settings(settings), callback(NULL), tileSize(256), overlap(0), dir(NULL)
+{
+    request.data = this;
+}
+
+TileRender::~TileRender()
+{
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        if (tiles[i].data)
+            free(tiles[i].data);
+        if (tiles[i].path)
+            delete[] tiles[i].path;
+    }
+    if (dir)
+        delete[] dir;
+    if (callback != NULL)
+        delete callback;
+    delete settings;
+}
+
+/**
+     * Parses tiling options, \see NodePopplerPage::renderTiles
+     */
+void TileRender::setOptions(const Local<Value> optsVal)
+{
+    Nan::HandleScope scope;
+    Local<v8::Object> options = To<v8::Object>(optsVal).ToLocalChecked();
+    Local<String> lk = Nan::New("levels").ToLocalChecked();
+    Local<String> tk = Nan::New("tileSize").ToLocalChecked();
+    Local<String> ok = Nan::New("overlap").ToLocalChecked();
+    Local<String> pk = Nan::New("path").ToLocalChecked();
+    const char *e = NULL;
+
+    Local<Value> lv = options->Get(lk);
+    if (!lv->IsArray() || Local<v8::Array>::Cast(lv)->Length() == 0)
+    {
+        e = "'levels' option must be a non-empty Array of PPI values";
+    }
+    else
+    {
+        Local<v8::Array> la = Local<v8::Array>::Cast(lv);
+        for (uint32_t i = 0; i < la->Length(); i++)
+        {
+            Local<Value> ppi = la->Get(i);
+            if (!ppi->IsNumber() || To<double>(ppi).FromJust() <= 0)
+            {
+                e = "'levels' option must be a non-empty Array of PPI values";
+                break;
+            }
+            levels.push_back(To<double>(ppi).FromJust());
+        }
+    }
+    if (options->Has(tk))
+    {
+        Local<Value> tv = options->Get(tk);
+        if (tv->IsUint32() && To<uint32_t>(tv).FromJust() > 0)
+        {
+            tileSize = To<uint32_t>(tv).FromJust();
+        }
+        else
+        {
+            e = "'tileSize' option value must be a positive integer";
+        }
+    }
+    if (options->Has(ok))
+    {
+        Local<Value> ov = options->Get(ok);
+        if (ov->IsUint32())
+        {
+            overlap = To<uint32_t>(ov).FromJust();
+        }
+        else
+        {
+            e = "'overlap' option value must be a non-negative integer";
+        }
+    }
+    if (options->Has(pk))
+    {
+        Local<Value> pv = options->Get(pk);
+        Nan::Utf8String p(pv);
+        if (pv->IsString() && p.length() > 0)
+        {
+            dir = new char[p.length() + 1];
+            strcpy(dir, *p);
+            if (settings->w == NodePopplerPage::W_RAW)
+            {
+                e = "'raw' format could be rendered only to a buffer";
+            }
+        }
+        else
+        {
+            e = "'path' option must be a non-empty string";
+        }
+    }
+    if (settings->colorMode == NodePopplerPage::CM_MONO)
+    {
+        // tiles are cut at pixel offsets, not byte ones
+        e = "'mono' color mode is not supported by renderTiles";
+    }
+    if (e)
+    {
+        settings->setError(e);
+    }
+}
+
+/**
+     * Renders tiles on the render pool if there is a callback,
+     * otherwise right away
+     */
+void TileRender::start()
+{
+    if (callback == NULL)
+    {
+        if (settings->watchSignal(false, NULL))
+            render();
+    }
+    else if (!settings->watchSignal(true, &request))
+    {
+        After(&request, 0);
+    }
+    else if (!RenderThreadPool::get()->queue(&request, Work, After))
+    {
+        settings->setError("Render queue is full");
+        After(&request, 0);
+    }
+}
+
+void TileRender::render()
+{
+    if (dir != NULL && mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        settings->setError("Could not create tile directory");
+        return;
+    }
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        if (!renderLevel(i))
+            return;
+    }
+}
+
+/**
+     * Rasterizes one zoom level and cuts it into tiles
+     */
+bool TileRender::renderLevel(int level)
+{
+    if (dir != NULL)
+    {
+        char levelDir[PATH_MAX];
+        snprintf(levelDir, sizeof(levelDir), "%s/%d", dir, level);
+        if (mkdir(levelDir, 0777) != 0 && errno != EEXIST)
+        {
+            settings->setError("Could not create tile directory");
+            return false;
+        }
+    }
+
+    settings->PPI = levels[level];
+    RendererPool::Renderer *renderer;
+    SplashOutputDev *splashOut = NodePopplerPage::rasterize(settings, &renderer);
+    if (splashOut == NULL)
+        return false;
+
+    SplashBitmap *bitmap = splashOut->getBitmap();
+    int width = bitmap->getWidth();
+    int height = bitmap->getHeight();
+    bool ok = true;
+    for (int row = 0; ok && row * tileSize < height; row++)
+    {
+        for (int col = 0; ok && col * tileSize < width; col++)
+        {
+            Tile tile;
+            tile.level = level;
+            tile.col = col;
+            tile.row = row;
+            tile.x = col * tileSize > overlap ? col * tileSize - overlap : 0;
+            tile.y = row * tileSize > overlap ? row * tileSize - overlap : 0;
+            tile.width = std::min(width, (col + 1) * tileSize + overlap) - tile.x;
+            tile.height = std::min(height, (row + 1) * tileSize + overlap) - tile.y;
+            tile.data = NULL;
+            tile.length = 0;
+            tile.path = NULL;
+            ok = encodeTile(bitmap, tile);
+            tiles.push_back(tile);
+        }
+    }
+    settings->parent->getRendererPool()->release(renderer);
+    return ok;
+}
+
+/**
+     * Encodes a region of the level bitmap to a buffer or a file
+     */
+bool TileRender::encodeTile(SplashBitmap *bitmap, Tile &tile)
+{
+    int bpp = 3;
+    switch (bitmap->getMode())
+    {
+    case splashModeXBGR8:
+        bpp = 4;
+        break;
+    case splashModeMono8:
+        bpp = 1;
+        break;
+    default:
+        break;
+    }
+    int rowSize = bitmap->getRowSize();
+    unsigned char *origin = (unsigned char *)bitmap->getDataPtr() + (size_t)tile.y * rowSize + (size_t)tile.x * bpp;
+
+    if (settings->w == NodePopplerPage::W_RAW)
+    {
+        size_t stride = (size_t)tile.width * bpp;
+        tile.length = stride * tile.height;
+        tile.data = (char *)malloc(tile.length);
+        if (tile.data == NULL)
+        {
+            settings->setError("Could not allocate tile buffer");
+            return false;
+        }
+        for (int y = 0; y < tile.height; y++)
+        {
+            unsigned char *row = (unsigned char *)tile.data + y * stride;
+            memcpy(row, origin + (size_t)y * rowSize, stride);
+            if (settings->pixelFormat == NodePopplerPage::PF_RGBA)
+                xbgrToRGBA(row, tile.width);
+            else if (settings->pixelFormat == NodePopplerPage::PF_BGRA)
+                xbgrToBGRA(row, tile.width);
+        }
+        return true;
+    }
+
+    MemoryStream *stream = NULL;
+    FILE *f;
+    if (dir != NULL)
+    {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%d/%d_%d.%s", dir, tile.level, tile.col, tile.row, settings->format);
+        tile.path = new char[strlen(path) + 1];
+        strcpy(tile.path, path);
+        f = fopen(path, "wb");
+    }
+    else
+    {
+        stream = new MemoryStream();
+        stream->reserve(settings->estimateOutputSize(tile.width, tile.height));
+        f = stream->open();
+    }
+    if (!f)
+    {
+        if (stream)
+            delete stream;
+        settings->setError("Could not open output stream");
+        return false;
+    }
+
+    std::vector<unsigned char *> rows(tile.height);
+    for (int y = 0; y < tile.height; y++)
+    {
+        rows[y] = origin + (size_t)y * rowSize;
+    }
+    ImgWriter *writer = settings->createWriter();
+    bool ok = writer->init(f, tile.width, tile.height, (int)settings->PPI, (int)settings->PPI) &&
+              writer->writePointers(&rows[0], tile.height) &&
+              writer->close();
+    delete writer;
+    fclose(f);
+    if (stream)
+    {
+        tile.length = stream->getBufferLen();
+        tile.data = stream->giveBuffer();
+        delete stream;
+    }
+    if (!ok)
+    {
+        settings->setError("Could not encode tile");
+    }
+    return ok;
+}
+
+void TileRender::Work(RenderTask *req)
+{
+    TileRender *self = static_cast<TileRender *>(req->data);
+    // cancelled while the thread was picking it up
+    if (!self->settings->checkCancelled())
+        self->render();
+}
+
+void TileRender::After(RenderTask *req, int status)
+{
+    Nan::HandleScope scope;
+    TileRender *self = static_cast<TileRender *>(req->data);
+    Local<Value> argv[] = {Nan::Null(), Nan::Undefined()};
+    self->settings->unwatchSignal();
+    if (status == UV_ECANCELED || self->settings->isCancelled())
+    {
+        self->settings->checkCancelled();
+    }
+    if (self->settings->error)
+    {
+        argv[0] = self->settings->errorValue();
+    }
+    else
+    {
+        argv[1] = self->result();
+    }
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::render-tiles").ToLocalChecked());
+    self->callback->Call(2, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
+    }
+    delete self;
+}
+
+/**
+     * Builds `renderTiles` result array
+     */
+Local<v8::Array> TileRender::result()
+{
+    const char *pixelFormatNames[] = {"rgb", "rgba", "bgra", "gray"};
+    Local<v8::Array> out = Nan::New<v8::Array>(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        Tile &tile = tiles[i];
+        Local<v8::Object> t = Nan::New<v8::Object>();
+        t->Set(Nan::New("level").ToLocalChecked(), Nan::New<Int32>(tile.level));
+        t->Set(Nan::New("col").ToLocalChecked(), Nan::New<Int32>(tile.col));
+        t->Set(Nan::New("row").ToLocalChecked(), Nan::New<Int32>(tile.row));
+        t->Set(Nan::New("x").ToLocalChecked(), Nan::New<Int32>(tile.x));
+        t->Set(Nan::New("y").ToLocalChecked(), Nan::New<Int32>(tile.y));
+        t->Set(Nan::New("width").ToLocalChecked(), Nan::New<Int32>(tile.width));
+        t->Set(Nan::New("height").ToLocalChecked(), Nan::New<Int32>(tile.height));
+        t->Set(Nan::New("format").ToLocalChecked(), Nan::New(settings->format).ToLocalChecked());
+        if (tile.path)
+        {
+            t->Set(Nan::New("type").ToLocalChecked(), Nan::New("file").ToLocalChecked());
+            t->Set(Nan::New("path").ToLocalChecked(), Nan::New(tile.path).ToLocalChecked());
+        }
+        else
+        {
+            t->Set(Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
+            Local<v8::Object> data = tile.data != NULL
+                                         ? Nan::NewBuffer(tile.data, tile.length, freeTileBuffer, NULL).ToLocalChecked()
+                                         : Nan::NewBuffer(0).ToLocalChecked();
+            tile.data = NULL;
+            t->Set(Nan::New("data").ToLocalChecked(), data);
+        }
+        if (settings->w == NodePopplerPage::W_RAW)
+        {
+            int bpp = settings->pixelFormat == NodePopplerPage::PF_GRAY ? 1 : settings->pixelFormat == NodePopplerPage::PF_RGB ? 3 : 4;
+            t->Set(Nan::New("stride").ToLocalChecked(), Nan::New<Int32>(tile.width * bpp));
+            t->Set(Nan::New("pixelFormat").ToLocalChecked(),
+                   Nan::New(pixelFormatNames[settings->pixelFormat]).ToLocalChecked());
+        }
+        out->Set(i, t);
+    }
+    return out;
+}
+} // namespace node
@@ -0,0 +1,60 @@
+#ifndef __TILE_RENDER
+#define __TILE_RENDER
+#include <v8.h>
+#include <nan.h>
+#include <vector>
+
+#include "NodePopplerPage.h"
+
+namespace node
+{
+/**
+ * Renders a page as a pyramid of tiles.
+ *
+ * Every zoom level is rasterized once, and all tiles of the level are
+ * cut from that bitmap and encoded separately, so page content is
+ * interpreted once per level rather than once per tile.
+ */
+class TileRender
+{
+  public:
+    struct Tile
+    {
+        int level;
+        int col;
+        int row;
+        int x;
+        int y;
+        int width;
+        int height;
+        char *data;
+        size_t length;
+        char *path;
+    };
+
+    TileRender(NodePopplerPage::RenderWork *settings);
+    ~TileRender();
+
+    void setOptions(const v8::Local<v8::Value> optsVal);
+    void start();
+    void render();
+    v8::Local<v8::Array> result();
+
+    NodePopplerPage::RenderWork *settings;
+    Nan::Callback *callback;
+
+  private:
+    static void Work(RenderTask *req);
+    static void After(RenderTask *req, int status);
+    bool renderLevel(int level);
+    bool encodeTile(SplashBitmap *bitmap, Tile &tile);
+
+    std::vector<double> levels;
+    std::vector<Tile> tiles;
+    int tileSize;
+    int overlap;
+    char *dir;
+    RenderTask request;
+};
+} // namespace node
+#endif
@@ -0,0 +1,240 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "VariantRender.h"
+#include "NodePopplerDocument.h"
+
+using namespace v8;
+
+namespace node
+{
+
+VariantRender::VariantRender(NodePopplerPage::RenderWork *master)
+    : master(master), callback(NULL)
+{
+    request.data = this;
+}
+
+VariantRender::~VariantRender()
+{
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        delete variants[i];
+    }
+    if (callback != NULL)
+        delete callback;
+    delete master;
+}
+
+/**
+     * Renders variants on the render pool if there is a callback,
+     * otherwise right away
+     */
+void VariantRender::start()
+{
+    if (callback == NULL)
+    {
+        if (master->watchSignal(false, NULL))
+            render();
+    }
+    else if (!master->watchSignal(true, &request))
+    {
+        After(&request, 0);
+    }
+    else if (!RenderThreadPool::get()->queue(&request, Work, After))
+    {
+        master->setError("Render queue is full");
+        After(&request, 0);
+    }
+}
+
+void VariantRender::render()
+{
+    master->PPI = 0;
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        master->PPI = std::max(master->PPI, variants[i]->PPI);
+    }
+
+    RendererPool::Renderer *renderer;
+    SplashOutputDev *splashOut = NodePopplerPage::rasterize(master, &renderer);
+    if (splashOut == NULL)
+        return;
+    // the bitmap is ours now, so the renderer can serve other pages
+    SplashBitmap *bitmap = splashOut->takeBitmap();
+    master->parent->getRendererPool()->release(renderer);
+
+    int width = bitmap->getWidth();
+    int height = bitmap->getHeight();
+    size_t stride = bitmap->getRowSize();
+    const unsigned char *pixels = (const unsigned char *)bitmap->getDataPtr();
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        NodePopplerPage::RenderWork *variant = variants[i];
+        double ratio = master->PPI > 0 ? variant->PPI / master->PPI : 1;
+        int w = std::min(width, std::max(1, (int)lround(width * ratio)));
+        int h = std::min(height, std::max(1, (int)lround(height * ratio)));
+        bool ok;
+        if (w == width && h == height)
+        {
+            ok = encode(variant, pixels, w, h, stride);
+        }
+        else
+        {
+            size_t scaledStride = (size_t)w * 3;
+            unsigned char *scaled = (unsigned char *)malloc(scaledStride * h);
+            ok = scaled != NULL &&
+                 areaDownscale(pixels, width, height, stride, scaled, w, h, scaledStride, 3);
+            if (ok)
+            {
+                ok = encode(variant, scaled, w, h, scaledStride);
+            }
+            else
+            {
+                master->setError("Could not allocate variant bitmap");
+            }
+            free(scaled);
+        }
+        if (!ok)
+            break;
+    }
+    delete bitmap;
+}
+
+/**
+     * Encodes RGB pixels of one variant to its buffer
+     */
+bool VariantRender::encode(NodePopplerPage::RenderWork *variant, const unsigned char *pixels,
+                           int width, int height, size_t stride)
+{
+    if (variant->w == NodePopplerPage::W_RAW)
+    {
+        int bpp = variant->pixelFormat == NodePopplerPage::PF_GRAY ? 1 : variant->pixelFormat == NodePopplerPage::PF_RGB ? 3 : 4;
+        variant->width = width;
+        variant->height = height;
+        variant->stride = width * bpp;
+        variant->mstrm_len = (size_t)variant->stride * height;
+        variant->mstrm_buf = (char *)malloc(variant->mstrm_len);
+        if (variant->mstrm_buf == NULL)
+        {
+            master->setError("Could not allocate variant bitmap");
+            return false;
+        }
+        for (int y = 0; y < height; y++)
+        {
+            const unsigned char *src = pixels + (size_t)y * stride;
+            unsigned char *dst = (unsigned char *)variant->mstrm_buf + (size_t)y * variant->stride;
+            switch (variant->pixelFormat)
+            {
+            case NodePopplerPage::PF_RGB:
+                memcpy(dst, src, variant->stride);
+                break;
+            case NodePopplerPage::PF_RGBA:
+                rgbToRGBA(src, dst, width);
+                break;
+            case NodePopplerPage::PF_BGRA:
+                rgbToBGRA(src, dst, width);
+                break;
+            case NodePopplerPage::PF_GRAY:
+                rgbToGray(src, dst, width);
+                break;
+            }
+        }
+        return true;
+    }
+
+    variant->openStream();
+    if (variant->error)
+    {
+        master->setError(variant->error);
+        return false;
+    }
+    unsigned char *gray = NULL;
+    if (variant->colorMode == NodePopplerPage::CM_GRAY)
+    {
+        // the writer takes one byte per pixel
+        gray = (unsigned char *)malloc((size_t)width * height);
+        if (gray == NULL)
+        {
+            master->setError("Could not allocate variant bitmap");
+            return false;
+        }
+        for (int y = 0; y < height; y++)
+        {
+            rgbToGray(pixels + (size_t)y * stride, gray + (size_t)y * width, width);
+        }
+        pixels = gray;
+        stride = width;
+    }
+    std::vector<unsigned char *> rows(height);
+    for (int y = 0; y < height; y++)
+    {
+        rows[y] = (unsigned char *)pixels + (size_t)y * stride;
+    }
+    ImgWriter *writer = variant->createWriter();
+    bool ok = writer->init(variant->f, width, height, (int)variant->PPI, (int)variant->PPI) &&
+              writer->writePointers(&rows[0], height) &&
+              writer->close();
+    delete writer;
+    free(gray);
+    variant->closeStream();
+    if (!ok)
+    {
+        master->setError("Could not encode variant");
+    }
+    return ok;
+}
+
+void VariantRender::Work(RenderTask *req)
+{
+    VariantRender *self = static_cast<VariantRender *>(req->data);
+    // cancelled while the thread was picking it up
+    if (!self->master->checkCancelled())
+        self->render();
+}
+
+void VariantRender::After(RenderTask *req, int status)
+{
+    Nan::HandleScope scope;
+    VariantRender *self = static_cast<VariantRender *>(req->data);
+    Local<Value> argv[] = {Nan::Null(), Nan::Undefined()};
+    self->master->unwatchSignal();
+    if (status == UV_ECANCELED || self->master->isCancelled())
+    {
+        self->master->checkCancelled();
+    }
+    if (self->master->error)
+    {
+        argv[0] = self->master->errorValue();
+    }
+    else
+    {
+        argv[1] = self->result();
+    }
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::render-variants").ToLocalChecked());
+    self->callback->Call(2, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
+    }
+    delete self;
+}
+
+/**
+     * Builds `renderVariants` result array, in order of variants
+     */
+Local<v8::Array> VariantRender::result()
+{
+    Local<v8::Array> out = Nan::New<v8::Array>(variants.size());
+    for (size_t i = 0; i < variants.size(); i++)
+    {
+        Local<v8::Object> r = variants[i]->bufferResult();
+        r->Set(Nan::New("PPI").ToLocalChecked(), Nan::New<Number>(variants[i]->PPI));
+        out->Set(i, r);
+    }
+    return out;
+}
+} // namespace node
@@ -0,0 +1,41 @@
+#ifndef __VARIANT_RENDER
+#define __VARIANT_RENDER
+#include <v8.h>
+#include <nan.h>
+#include <vector>
+
+#include "NodePopplerPage.h"
+
+namespace node
+{
+/**
+ * Renders a page to several buffers of different resolution.
+ *
+ * The page is rasterized once at the highest requested PPI, smaller
+ * variants are area downscaled from that bitmap and every variant is
+ * encoded with its own format and options.
+ */
+class VariantRender
+{
+  public:
+    VariantRender(NodePopplerPage::RenderWork *master);
+    ~VariantRender();
+
+    void start();
+    void render();
+    v8::Local<v8::Array> result();
+
+    NodePopplerPage::RenderWork *master;
+    std::vector<NodePopplerPage::RenderWork *> variants;
+    Nan::Callback *callback;
+
+  private:
+    static void Work(RenderTask *req);
+    static void After(RenderTask *req, int status);
+    bool encode(NodePopplerPage::RenderWork *variant, const unsigned char *pixels,
+                int width, int height, size_t stride);
+
+    RenderTask request;
+};
+} // namespace node
+#endif
@@ -2,6 +2,10 @@
 #include <node.h>
 #include "NodePopplerDocument.h"
 #include "NodePopplerPage.h"
+#include "RenderThreadPool.h"
+#include "RenderStream.h"
+#include "RenderCache.h"
+#include "DiskCache.h"
 
 using namespace v8;
 using namespace node;
@@ -10,6 +14,10 @@ NAN_MODULE_INIT(InitAll) {
     globalParams = new GlobalParams();
     NodePopplerPage::Init(target);
     NodePopplerDocument::Init(target);
+    RenderThreadPool::Init(target);
+    RenderStream::Init(target);
+    RenderCache::Init(target);
+    DiskCache::Init(target);
 }
 
 NODE_MODULE(poppler, InitAll)
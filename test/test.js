@@ -1,4 +1,4 @@
-/*global it:true, describe:true, require:true, __dirname:true, gc:true, before:true */
+/*global it:true, describe:true, require:true, __dirname:true, gc:true, before:true, after:true */
 /*jshint node:true */
 'use strict';
 
@@ -182,6 +182,47 @@ describe('PopplerDocument', function () {
             a.equal(d.fileName, null);
         }
     });
+    it('should open pdf from memory without copying', function () {
+        this.timeout(0);
+        var data = fs.readFileSync(names[0]);
+        var ab = data.buffer.slice(data.byteOffset, data.byteOffset + data.length);
+        var sab = new SharedArrayBuffer(data.length);
+        data.copy(Buffer.from(sab));
+        [data, sab].forEach(function (x) {
+            var d = new poppler.PopplerDocument(x, null, null, { copy: false });
+            a.equal(d.pageCount, 1);
+            a.equal(d.fileName, null);
+            a.ok(d.getPage(1).renderToBuffer('png', 20).data.length > 0);
+        });
+        a.equal(new poppler.PopplerDocument(ab).pageCount, 1);
+        a.throws(function () {
+            new poppler.PopplerDocument(ab, null, null, { copy: false });
+        }, /'copy' option value false is not supported for ArrayBuffer/);
+    });
+    it('should open mapped pdf file', function () {
+        this.timeout(0);
+        ['normal', 'random', 'sequential'].forEach(function (access, i) {
+            var d = new poppler.PopplerDocument(targets[i], null, null, { mmap: true, access: access });
+            a.equal(d.pageCount, 1);
+            a.equal(d.pdfVersion, 'PDF-1.4');
+            a.equal(d.fileName, names[i]);
+            a.ok(d.getPage(1).renderToBuffer('png', 20).data.length > 0);
+        });
+        a.throws(function () {
+            new poppler.PopplerDocument('file:///123.pdf', null, null, { mmap: true });
+        }, new RegExp('Couldn\'t open file - fopen error. Errno: 2.'));
+    });
+    it('should throw on bad document options', function () {
+        a.throws(function () {
+            new poppler.PopplerDocument(fs.readFileSync(names[0]), null, null, { copy: 'no' });
+        }, /'copy' option value must be a boolean value/);
+        a.throws(function () {
+            new poppler.PopplerDocument(names[0], null, null, { mmap: 1 });
+        }, /'mmap' option value must be a boolean value/);
+        a.throws(function () {
+            new poppler.PopplerDocument(names[0], null, null, { mmap: true, access: 'often' });
+        }, /Unsupported 'access' option value/);
+    });
     it('should open an encrypted pdf file', function () {
         this.timeout(0);
         var fileName = __dirname + '/fixtures/encrypted.pdf';
@@ -387,6 +428,19 @@ describe('PopplerPage', function () {
             p.deleteAnnots();
             a.equal(p.numAnnots, 8);
         });
+        it('should render added annotations asynchronously', function () {
+            this.timeout(0);
+            var p = new poppler.PopplerDocument(__dirname + '/fixtures/annot.pdf').getPage(1);
+            var plain = p.renderToBuffer('raw', 20).data;
+            p.addAnnot(p.findText('Лейла'));
+            return p.renderToBufferAsync('raw', 20).then(function (out) {
+                a.notDeepEqual(out.data, plain);
+                p.deleteAnnots();
+                return p.renderToBufferAsync('raw', 20);
+            }).then(function (out) {
+                a.deepEqual(out.data, plain);
+            });
+        });
     }
     describe('render to file', function () {
         it('should render to png', function () {
@@ -441,6 +495,12 @@ describe('PopplerPage', function () {
                 }, new RegExp('\'quality\' option value must be 0 - 100 interval integer'));
             });
         });
+        it('should throw on raw format', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToFile('test/x.raw', 'raw', 50);
+            }, new RegExp('\'raw\' format could be rendered only to a buffer'));
+        });
     });
     describe('render to file async', function () {
         it('should render to png', function () {
@@ -501,6 +561,47 @@ describe('PopplerPage', function () {
             this.timeout(0);
             return renderToBuffer(pages, 'tiff');
         });
+        it('should render tiff without temporary files', function () {
+            this.timeout(0);
+            pages.forEach(function (x) {
+                var out = x.renderToBuffer('tiff', 50, { compression: 'lzw' });
+                var magic = out.data.slice(0, 4).toString('binary');
+                a.ok(magic === 'II*\u0000' || magic === 'MM\u0000*');
+            });
+        });
+        it('should render the same output with reused renderers', function () {
+            this.timeout(0);
+            pages.forEach(function (x) {
+                var first = x.renderToBuffer('png', 50).data;
+                var second = x.renderToBuffer('png', 50).data;
+                a.ok(first.equals(second));
+            });
+        });
+        it('should render raw pixels', function () {
+            this.timeout(0);
+            [['rgb', 3], ['rgba', 4], ['bgra', 4], ['gray', 1]].forEach(function (f) {
+                var out = pages[0].renderToBuffer('raw', 50, { pixelFormat: f[0] });
+                a.equal(out.format, 'raw');
+                a.equal(out.pixelFormat, f[0]);
+                a.ok(out.width > 0 && out.height > 0);
+                a.ok(out.stride >= out.width * f[1]);
+                a.equal(out.data.length, out.stride * out.height);
+            });
+            var rgba = pages[0].renderToBuffer('raw', 50, { pixelFormat: 'rgba' }).data;
+            var bgra = pages[0].renderToBuffer('raw', 50, { pixelFormat: 'bgra' }).data;
+            for (var i = 0; i < rgba.length; i += 4) {
+                a.equal(rgba[i], bgra[i + 2]);
+                a.equal(rgba[i + 1], bgra[i + 1]);
+                a.equal(rgba[i + 2], bgra[i]);
+                a.equal(rgba[i + 3], 255);
+            }
+        });
+        it('should throw on unsupported tiff compression', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToBuffer('tiff', 50, { compression: 'foobar' });
+            }, new RegExp('Unsupported \'compression\' option value'));
+        });
     });
     describe('render to buffer async', function () {
         it('should render to png', function () {
@@ -515,6 +616,19 @@ describe('PopplerPage', function () {
             this.timeout(0);
             return renderToBufferCb(pages, 'tiff');
         });
+        it('should render one document in parallel', function () {
+            this.timeout(0);
+            var expected = pages[0].renderToBuffer('png', 50).data;
+            var promises = [];
+            for (var i = 0; i < 8; i++) {
+                promises.push(pages[0].renderToBufferAsync('png', 50));
+            }
+            return Promise.all(promises).then(function (outs) {
+                outs.forEach(function (out) {
+                    a.ok(out.data.equals(expected));
+                });
+            });
+        });
         it('should pass errors asyncronously', function (done) {
             this.timeout(0);
             pages[0].renderToBuffer('jpg', 50, function (err, out) {
@@ -539,6 +653,741 @@ describe('PopplerPage', function () {
             return renderToBufferAsync(pages, 'tiff');
         });
     });
+
+    describe('render pages', function () {
+        it('should render a list of pages', function (done) {
+            this.timeout(0);
+            docs[0].renderPages([1, 1, 1], 'png', 50, function (err, out) {
+                a.equal(err, null);
+                a.equal(out.length, 3);
+                out.forEach(function (x) {
+                    a.equal(x.type, 'buffer');
+                    a.equal(x.format, 'png');
+                    a.equal(x.page, 1);
+                    a.ok(x.data.length > 0);
+                });
+                done();
+            });
+        });
+        it('should deliver pages incrementally', function (done) {
+            this.timeout(0);
+            var count = 0;
+            docs[0].renderPages([1, 1], 'jpeg', 50, {
+                parallelism: 1,
+                onPage: function (err, out) {
+                    a.equal(err, null);
+                    a.equal(out.page, 1);
+                    count++;
+                }
+            }, function (err, out) {
+                a.equal(err, null);
+                a.equal(out, undefined);
+                a.equal(count, 2);
+                done();
+            });
+        });
+        it('should render pages to promise', function () {
+            this.timeout(0);
+            return docs[0].renderPagesAsync([1], 'tiff', 50).then(function (out) {
+                a.equal(out.length, 1);
+                a.equal(out[0].format, 'tiff');
+            });
+        });
+        it('should pass error on bad page number', function (done) {
+            this.timeout(0);
+            docs[0].renderPages([1, 2], 'png', 50, function (err, out) {
+                a.equal(out, undefined);
+                a.equal(err.message, 'Page number out of bounds.');
+                done();
+            });
+        });
+    });
+
+    describe('render to stream', function () {
+        it('should stream the same bytes as buffer render', function (done) {
+            this.timeout(0);
+            var expected = pages[0].renderToBuffer('png', 100).data;
+            var chunks = [];
+            pages[0].createRenderStream('png', 100, { highWaterMark: 1024 })
+                .on('data', function (chunk) {
+                    chunks.push(chunk);
+                })
+                .on('end', function () {
+                    a.ok(Buffer.concat(chunks).equals(expected));
+                    done();
+                });
+        });
+        it('should wait for a paused consumer', function (done) {
+            this.timeout(0);
+            var chunks = [];
+            var control = pages[0].renderToChunks('png', 100, { highWaterMark: 0 }, function (chunk) {
+                chunks.push(chunk);
+                setTimeout(function () {
+                    control.resume();
+                }, 1);
+                return false;
+            }, function (err, out) {
+                a.equal(err, null);
+                a.equal(out.type, 'stream');
+                a.ok(chunks.length > 0);
+                done();
+            });
+        });
+        it('should not block the document while paused', function (done) {
+            this.timeout(0);
+            var doc = new poppler.PopplerDocument(__dirname + '/fixtures/annot.pdf');
+            var p = doc.getPage(1);
+            p.addAnnot(p.findText('Лейла'));
+            var paused = false;
+            var control = p.renderToChunks('png', 100, { highWaterMark: 0 }, function () {
+                if (paused)
+                    return true;
+                paused = true;
+                setTimeout(function () {
+                    a.ok(doc.pageCount >= 1);
+                    a.ok(doc.getPage(1).findText('Лейла').length > 0);
+                    control.resume();
+                }, 10);
+                return false;
+            }, function (err) {
+                a.equal(err, null);
+                a.ok(paused);
+                done();
+            });
+        });
+        it('should fail after cancel', function (done) {
+            this.timeout(0);
+            var control = pages[0].renderToChunks('png', 100, {}, function () {
+                control.cancel();
+                return false;
+            }, function (err) {
+                a.equal(err.message, 'Render stream was cancelled');
+                done();
+            });
+        });
+        it('should pass error on tiff', function (done) {
+            pages[0].createRenderStream('tiff', 50).on('error', function (err) {
+                a.ok(/Only 'png' and 'jpeg' formats/.test(err.message));
+                done();
+            });
+        });
+        it('should pass argument error to piped stream', function (done) {
+            var sink = new (require('stream').Writable)({
+                write: function (chunk, encoding, cb) {
+                    cb();
+                }
+            });
+            var stream = pages[0].createRenderStream('tiff', 50);
+            stream.on('error', function (err) {
+                a.ok(/Only 'png' and 'jpeg' formats/.test(err.message));
+                a.doesNotThrow(function () {
+                    stream.destroy();
+                });
+                done();
+            });
+            stream.pipe(sink);
+        });
+    });
+
+    describe('estimate cost', function () {
+        it('should count page content', function () {
+            var cost = pages[0].estimateCost();
+            a.ok(cost.operators > 0);
+            a.ok(cost.operators >= cost.pathOperators + cost.textOperators);
+            a.ok(cost.fonts > 0);
+            a.equal(cost.outputPixels, Math.floor(pages[0].width) * Math.floor(pages[0].height));
+        });
+        it('should scale output pixels with PPI', function () {
+            var cost = pages[0].estimateCost(144);
+            a.equal(cost.outputPixels, Math.floor(pages[0].width * 2) * Math.floor(pages[0].height * 2));
+            a.deepEqual(Object.assign({}, cost, { outputPixels: 0 }),
+                Object.assign({}, pages[0].estimateCost(), { outputPixels: 0 }));
+        });
+        it('should throw on bad PPI', function () {
+            a.throws(function () {
+                pages[0].estimateCost('high');
+            }, /'PPI' must be an instance of number/);
+        });
+    });
+
+    describe('render tiles', function () {
+        it('should cut tiles from one level bitmap', function () {
+            this.timeout(0);
+            var full = pages[0].renderToBuffer('raw', 72);
+            var tiles = pages[0].renderTiles('raw', { levels: [36, 72], tileSize: 64 });
+            var level = tiles.filter(function (t) {
+                return t.level === 1;
+            });
+            a.equal(level.length, Math.ceil(full.width / 64) * Math.ceil(full.height / 64));
+            level.forEach(function (t) {
+                a.equal(t.data.length, t.stride * t.height);
+                for (var y = 0; y < t.height; y++) {
+                    var offset = (t.y + y) * full.stride + t.x * 3;
+                    a.ok(t.data.slice(y * t.stride, (y + 1) * t.stride)
+                        .equals(full.data.slice(offset, offset + t.width * 3)));
+                }
+            });
+        });
+        it('should render encoded tiles to promise', function () {
+            this.timeout(0);
+            return pages[0].renderTilesAsync('png', { levels: [36], tileSize: 128, overlap: 1 }).then(function (tiles) {
+                a.ok(tiles.length > 0);
+                tiles.forEach(function (t) {
+                    a.equal(t.format, 'png');
+                    a.equal(t.data.slice(1, 4).toString(), 'PNG');
+                });
+            });
+        });
+        it('should write tiles to a directory', function () {
+            this.timeout(0);
+            var dir = __dirname + '/tiles';
+            var tiles = pages[0].renderTiles('jpeg', { levels: [36], path: dir });
+            tiles.forEach(function (t) {
+                a.equal(t.path, dir + '/0/' + t.col + '_' + t.row + '.jpeg');
+                a.ok(fs.statSync(t.path).size > 0);
+                fs.unlinkSync(t.path);
+            });
+            fs.rmdirSync(dir + '/0');
+            fs.rmdirSync(dir);
+        });
+        it('should throw without levels', function () {
+            a.throws(function () {
+                pages[0].renderTiles('png', { tileSize: 64 });
+            }, new RegExp('\'levels\' option must be a non-empty Array'));
+        });
+    });
+
+    describe('render variants', function () {
+        it('should render all variants from one rasterization', function () {
+            this.timeout(0);
+            var full = pages[0].renderToBuffer('raw', 72);
+            var out = pages[0].renderVariants([
+                { format: 'jpeg', ppi: 18, quality: 70 },
+                { format: 'png', ppi: 36 },
+                { format: 'raw', ppi: 72 },
+                { format: 'raw', ppi: 36, pixelFormat: 'rgba' },
+            ]);
+            a.equal(out.length, 4);
+            a.equal(out[0].format, 'jpeg');
+            a.equal(out[1].format, 'png');
+            a.equal(out[2].width, full.width);
+            for (var y = 0; y < full.height; y++) {
+                a.ok(out[2].data.slice(y * out[2].stride, (y + 1) * out[2].stride)
+                    .equals(full.data.slice(y * full.stride, y * full.stride + full.width * 3)));
+            }
+            a.equal(out[3].width, Math.round(full.width / 2));
+            a.equal(out[3].data.length, out[3].width * out[3].height * 4);
+        });
+        it('should render variants to promise', function () {
+            this.timeout(0);
+            return pages[0].renderVariantsAsync([{ format: 'tiff', ppi: 20 }, { format: 'png', ppi: 40 }]).then(function (out) {
+                a.equal(out.length, 2);
+                a.equal(out[0].PPI, 20);
+                a.equal(out[1].data.slice(1, 4).toString(), 'PNG');
+            });
+        });
+        it('should throw on bad variant', function () {
+            a.throws(function () {
+                pages[0].renderVariants([{ format: 'gif', ppi: 20 }]);
+            }, new RegExp('Unsupported compression method'));
+        });
+    });
+
+    describe('render color modes', function () {
+        // PNG IHDR bit depth and color type
+        function pngMode(data) {
+            return [data[24], data[25]];
+        }
+        it('should render grayscale png', function () {
+            this.timeout(0);
+            var out = pages[0].renderToBuffer('png', 50, { colorMode: 'gray' });
+            a.deepEqual(pngMode(out.data), [8, 0]);
+        });
+        it('should render bilevel png', function () {
+            this.timeout(0);
+            var out = pages[0].renderToBuffer('png', 50, { colorMode: 'mono' });
+            a.deepEqual(pngMode(out.data), [1, 0]);
+        });
+        it('should render bilevel tiff', function () {
+            this.timeout(0);
+            var rgb = pages[0].renderToBuffer('tiff', 100, { compression: 'lzw' });
+            var mono = pages[0].renderToBuffer('tiff', 100, { colorMode: 'mono' });
+            a.ok(mono.data.length < rgb.data.length);
+        });
+        it('should render grayscale jpeg asynchronously', function () {
+            this.timeout(0);
+            return pages[0].renderToBufferAsync('jpeg', 50, { colorMode: 'gray' }).then(function (out) {
+                a.ok(out.data.length > 0);
+            });
+        });
+        it('should reject unsupported color modes', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('jpeg', 50, { colorMode: 'mono' });
+            }, /'mono' color mode is not supported by 'jpeg' method/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { colorMode: 'cmyk' });
+            }, /Unsupported 'colorMode' option value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('tiff', 50, { compression: 'ccittfax4' });
+            }, /CCITT compression requires 'mono' color mode/);
+        });
+    });
+
+    describe('jpeg encoder options', function () {
+        // sampling factors of the luma component in the SOF0/SOF2 header
+        function lumaSampling(data) {
+            for (var i = 2; i < data.length - 11; i++) {
+                if (data[i] === 0xff && (data[i + 1] === 0xc0 || data[i + 1] === 0xc2)) {
+                    return data[i + 11];
+                }
+            }
+            return -1;
+        }
+        it('should use requested chroma subsampling', function () {
+            this.timeout(0);
+            a.equal(lumaSampling(pages[0].renderToBuffer('jpeg', 50).data), 0x22);
+            a.equal(lumaSampling(pages[0].renderToBuffer('jpeg', 50, { subsampling: '4:2:2' }).data), 0x21);
+            a.equal(lumaSampling(pages[0].renderToBuffer('jpeg', 50, { subsampling: '4:4:4' }).data), 0x11);
+        });
+        it('should produce smaller output with optimized tables', function () {
+            this.timeout(0);
+            var plain = pages[0].renderToBuffer('jpeg', 50, { quality: 80 });
+            var optimized = pages[0].renderToBuffer('jpeg', 50, { quality: 80, optimize: true });
+            a.ok(optimized.data.length < plain.data.length);
+        });
+        it('should write restart markers', function () {
+            this.timeout(0);
+            var out = pages[0].renderToBuffer('jpeg', 50, { restartInterval: 1, dctMethod: 'fast' });
+            a.ok(out.data.indexOf(Buffer.from([0xff, 0xdd])) > 0);
+        });
+        it('should reject bad encoder options', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('jpeg', 50, { subsampling: '4:1:1' });
+            }, /Unsupported 'subsampling' option value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('jpeg', 50, { dctMethod: 'slow' });
+            }, /Unsupported 'dctMethod' option value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('jpeg', 50, { restartInterval: 70000 });
+            }, /'restartInterval' option value must be 0 - 65535 interval integer/);
+        });
+    });
+
+    describe('png encoder options', function () {
+        it('should write indexed color png', function () {
+            this.timeout(0);
+            var rgb = pages[0].renderToBuffer('png', 50);
+            var indexed = pages[0].renderToBuffer('png', 50, { palette: true });
+            a.equal(indexed.data[25], 3);
+            a.ok(indexed.data.length < rgb.data.length);
+        });
+        it('should trade size for speed with compression level', function () {
+            this.timeout(0);
+            var fast = pages[0].renderToBuffer('png', 50, { compressionLevel: 1, filter: 'none' });
+            var best = pages[0].renderToBuffer('png', 50, { compressionLevel: 9, compressionStrategy: 'filtered', filter: 'all' });
+            a.ok(best.data.length < fast.data.length);
+        });
+        it('should reject bad encoder options', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { compressionLevel: 10 });
+            }, /'compressionLevel' option value must be 0 - 9 interval integer/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { filter: 'median' });
+            }, /Unsupported 'filter' option value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { palette: true, colorMode: 'gray' });
+            }, /'palette' option requires 'rgb' color mode/);
+        });
+    });
+
+    describe('banded render', function () {
+        // inflated IDAT data of a png
+        function pngRows(data) {
+            var chunks = [];
+            for (var i = 8; i < data.length; ) {
+                var len = data.readUInt32BE(i);
+                if (data.toString('ascii', i + 4, i + 8) === 'IDAT') {
+                    chunks.push(data.slice(i + 8, i + 8 + len));
+                }
+                i += len + 12;
+            }
+            return require('zlib').inflateSync(Buffer.concat(chunks));
+        }
+        it('should encode bands like a single bitmap', function () {
+            this.timeout(0);
+            var opts = { filter: 'none', compressionLevel: 1 };
+            var whole = pngRows(pages[0].renderToBuffer('png', 72, opts).data);
+            var banded = pngRows(pages[0].renderToBuffer('png', 72, Object.assign({ bandHeight: 37 }, opts)).data);
+            a.equal(banded.length, whole.length);
+            var differing = 0;
+            for (var i = 0; i < whole.length; i++) {
+                if (whole[i] !== banded[i]) differing++;
+            }
+            a.ok(differing < whole.length / 100);
+        });
+        it('should render banded jpeg asynchronously', function () {
+            this.timeout(0);
+            return pages[1].renderToBufferAsync('jpeg', 72, { bandHeight: 100 }).then(function (out) {
+                a.equal(out.data[0], 0xff);
+                a.equal(out.data[1], 0xd8);
+            });
+        });
+        it('should reject bad band height', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 72, { bandHeight: 0 });
+            }, /'bandHeight' option value must be a positive integer/);
+            a.throws(function () {
+                pages[0].renderToBuffer('raw', 72, { bandHeight: 10 });
+            }, /'bandHeight' option is not supported by 'raw' method/);
+        });
+        it('should not band palette images', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 72, { palette: true, bandHeight: 10 });
+            }, /'bandHeight' option is not supported with 'palette' option/);
+            return pages[0].renderToBufferAsync('png', 1500, { palette: true }).then(function () {
+                a.fail('palette image over the bitmap limit was rendered');
+            }, function (err) {
+                a.equal(err.message, 'Result image is too big');
+            });
+        });
+    });
+
+    describe('render to output buffer', function () {
+        it('should write result into output buffer', function () {
+            var output = Buffer.alloc(4 * 1024 * 1024);
+            var out = pages[0].renderToBuffer('png', 50, { output: output });
+            a.equal(out.data.buffer, output.buffer);
+            a.ok(out.data.length > 0);
+            a.ok(out.data.equals(pages[0].renderToBuffer('png', 50).data));
+        });
+        it('should write raw result into output buffer', function () {
+            var output = Buffer.alloc(4 * 1024 * 1024);
+            var out = pages[0].renderToBuffer('raw', 50, { output: output });
+            a.equal(out.data.buffer, output.buffer);
+            a.equal(out.data.length, out.height * out.stride);
+        });
+        it('should fail when output buffer is too small', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { output: Buffer.alloc(16) });
+            }, function (err) {
+                return err.code === 'ERR_OUTPUT_TOO_SMALL' &&
+                    /doesn't fit into 'output' buffer/.test(err.message);
+            });
+        });
+        it('should fall back to allocated buffer', function () {
+            var output = Buffer.alloc(16);
+            var out = pages[0].renderToBuffer('png', 50, { output: output, outputFallback: true });
+            a.notEqual(out.data.buffer, output.buffer);
+            a.ok(out.data.equals(pages[0].renderToBuffer('png', 50).data));
+        });
+        it('should take output buffers from pool', function () {
+            var pool = new poppler.BufferPool(4 * 1024 * 1024, 1);
+            return pages[0].renderToBufferAsync('jpeg', 50, { output: pool }).then(function (out) {
+                pool.release(out.data);
+                var next = pool.acquire();
+                a.equal(next.buffer, out.data.buffer);
+                a.equal(next.length, 4 * 1024 * 1024);
+            });
+        });
+        it('should ignore foreign and repeated releases', function () {
+            var pool = new poppler.BufferPool(1024);
+            var buffer = pool.acquire();
+            pool.release(Buffer.alloc(1024));
+            pool.release(buffer);
+            pool.release(buffer.slice(0, 10));
+            var first = pool.acquire();
+            var second = pool.acquire();
+            a.equal(first.buffer, buffer.buffer);
+            a.notEqual(second.buffer, buffer.buffer);
+        });
+        it('should reject bad output', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { output: 'buffer' });
+            }, /'output' option must be a Buffer or an object with 'acquire' method/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { output: { acquire: function () { return 1; } } });
+            }, /'output' pool must return a Buffer/);
+        });
+    });
+
+    describe('render quality', function () {
+        it('should render with fast preset', function () {
+            this.timeout(0);
+            var normal = pages[0].renderToBuffer('raw', 50);
+            var fast = pages[0].renderToBuffer('raw', 50, { preset: 'fast' });
+            a.equal(fast.width, normal.width);
+            a.equal(fast.height, normal.height);
+            a.ok(!fast.data.equals(normal.data));
+        });
+        it('should let options override preset', function () {
+            this.timeout(0);
+            var normal = pages[0].renderToBuffer('raw', 50);
+            var out = pages[0].renderToBuffer('raw', 50, { preset: 'fast', vectorAntialias: true, textAntialias: true });
+            a.ok(out.data.equals(normal.data));
+        });
+        it('should render with hinting and thin line mode', function () {
+            this.timeout(0);
+            return pages[0].renderToBufferAsync('png', 50, { hinting: 'slight', thinLineMode: 'solid' }).then(function (out) {
+                a.ok(out.data.length > 0);
+            });
+        });
+        it('should render in draft mode', function () {
+            this.timeout(0);
+            // 512x512 DCT image drawn in one inch
+            var page = new poppler.PopplerDocument(__dirname + '/fixtures/jpeg.pdf').getPage(1);
+            var normal = page.renderToBuffer('raw', 20);
+            var draft = page.renderToBuffer('raw', 20, { draft: true });
+            a.equal(draft.width, normal.width);
+            a.equal(draft.height, normal.height);
+            a.equal(draft.data.length, normal.data.length);
+            a.ok(normal.data.some(function (b) {
+                return b < 128;
+            }));
+            // decoded at 1/8 scale rather than downsampled from full size
+            a.ok(!draft.data.equals(normal.data));
+            a.ok(draft.data.equals(page.renderToBuffer('raw', 20, { draft: true }).data));
+        });
+        it('should reject bad quality options', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { preset: 'ultra' });
+            }, /Unsupported 'preset' option value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { hinting: 'medium' });
+            }, /Unsupported 'hinting' option value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { textAntialias: 'no' });
+            }, /'textAntialias' option value must be a boolean value/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { draft: 1 });
+            }, /'draft' option value must be a boolean value/);
+        });
+    });
+
+    describe('render cache', function () {
+        before(function () {
+            poppler.clearRenderCache();
+            poppler.configureRenderCache({ maxBytes: 16 * 1024 * 1024 });
+        });
+        after(function () {
+            poppler.configureRenderCache({ maxBytes: 0 });
+        });
+        it('should serve repeated renders from cache', function () {
+            this.timeout(0);
+            var first = pages[0].renderToBuffer('png', 40);
+            var stats = poppler.getRenderCacheStats();
+            var second = pages[0].renderToBuffer('png', 40);
+            a.ok(first.data.equals(second.data));
+            a.equal(poppler.getRenderCacheStats().hits, stats.hits + 1);
+            a.ok(stats.entries > 0);
+        });
+        it('should serve async renders from cache', function () {
+            this.timeout(0);
+            var first = pages[1].renderToBuffer('jpeg', 40, { quality: 50 });
+            var stats = poppler.getRenderCacheStats();
+            return pages[1].renderToBufferAsync('jpeg', 40, { quality: 50 }).then(function (out) {
+                a.ok(first.data.equals(out.data));
+                a.equal(poppler.getRenderCacheStats().hits, stats.hits + 1);
+            });
+        });
+        it('should fail from cache when output buffer is too small', function () {
+            this.timeout(0);
+            var first = pages[0].renderToBuffer('png', 40);
+            var stats = poppler.getRenderCacheStats();
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 40, { output: Buffer.alloc(16) });
+            }, function (err) {
+                return err.code === 'ERR_OUTPUT_TOO_SMALL' &&
+                    err.message.indexOf(' ' + first.data.length + ' bytes') > 0;
+            });
+            return pages[0].renderToBufferAsync('png', 40, { output: Buffer.alloc(16) }).then(function () {
+                a.fail('render into a too small output buffer succeeded');
+            }, function (err) {
+                a.equal(err.code, 'ERR_OUTPUT_TOO_SMALL');
+                a.equal(poppler.getRenderCacheStats().hits, stats.hits + 2);
+                a.equal(poppler.getRenderCacheStats().misses, stats.misses);
+            });
+        });
+        it('should key renders by options', function () {
+            this.timeout(0);
+            var stats = poppler.getRenderCacheStats();
+            pages[0].renderToBuffer('png', 41);
+            a.equal(poppler.getRenderCacheStats().misses, stats.misses + 1);
+        });
+        it('should evict to stay within budget', function () {
+            this.timeout(0);
+            poppler.configureRenderCache({ maxBytes: 1 });
+            var stats = poppler.getRenderCacheStats();
+            a.equal(stats.entries, 0);
+            a.ok(stats.evictions > 0);
+        });
+    });
+
+    describe('disk cache', function () {
+        var dir = __dirname + '/cache';
+        before(function () {
+            poppler.configureDiskCache({ path: dir });
+        });
+        after(function () {
+            poppler.configureDiskCache({ path: null });
+            fs.readdirSync(dir).forEach(function (sub) {
+                fs.readdirSync(dir + '/' + sub).forEach(function (f) {
+                    fs.unlinkSync(dir + '/' + sub + '/' + f);
+                });
+                fs.rmdirSync(dir + '/' + sub);
+            });
+            fs.rmdirSync(dir);
+        });
+        it('should serve repeated renders from disk', function () {
+            this.timeout(0);
+            var first = pages[0].renderToBuffer('png', 42);
+            var stats = poppler.getDiskCacheStats();
+            a.equal(stats.writes, 1);
+            var second = pages[0].renderToBuffer('png', 42);
+            a.ok(first.data.equals(second.data));
+            a.equal(poppler.getDiskCacheStats().hits, stats.hits + 1);
+        });
+        it('should copy cached renders to files', function () {
+            this.timeout(0);
+            var first = pages[0].renderToBuffer('png', 42);
+            var stats = poppler.getDiskCacheStats();
+            return pages[0].renderToFileAsync(__dirname + '/cached.png', 'png', 42).then(function (out) {
+                a.equal(poppler.getDiskCacheStats().hits, stats.hits + 1);
+                a.ok(first.data.equals(fs.readFileSync(out.path)));
+                fs.unlinkSync(out.path);
+            });
+        });
+        it('should not apply options when one is invalid', function () {
+            var before = poppler.getDiskCacheStats();
+            a.throws(function () {
+                poppler.configureDiskCache({ maxBytes: before.maxBytes + 1024, path: 42 });
+            }, /'path' option must be an instance of string/);
+            var after = poppler.getDiskCacheStats();
+            a.equal(after.maxBytes, before.maxBytes);
+            a.equal(after.path, before.path);
+        });
+    });
+
+    describe('render cancellation', function () {
+        before(function () {
+            if (typeof AbortController === 'undefined') {
+                this.skip();
+            }
+        });
+        it('should not start aborted renders', function () {
+            var controller = new AbortController();
+            controller.abort();
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { signal: controller.signal });
+            }, function (err) {
+                return err.code === 'ERR_RENDER_CANCELLED';
+            });
+            return pages[0].renderToBufferAsync('png', 50, { signal: controller.signal }).then(function () {
+                a.fail('render was not cancelled');
+            }, function (err) {
+                a.equal(err.code, 'ERR_RENDER_CANCELLED');
+            });
+        });
+        it('should drop queued renders', function () {
+            this.timeout(0);
+            var threads = poppler.getRenderPoolStats().threads;
+            var stats = poppler.configureRenderPool({ threads: 1 });
+            var controller = new AbortController();
+            var promises = [];
+            for (var i = 0; i < 4; i++) {
+                promises.push(pages[0].renderToBufferAsync('png', 150, { signal: controller.signal }).reflect());
+            }
+            controller.abort();
+            return Promise.all(promises).then(function (results) {
+                poppler.configureRenderPool({ threads: threads });
+                results.forEach(function (r) {
+                    a.ok(r.isRejected());
+                    a.equal(r.reason().code, 'ERR_RENDER_CANCELLED');
+                });
+                a.ok(poppler.getRenderPoolStats().cancelled >= stats.cancelled + 3);
+            });
+        });
+        it('should not affect finished renders', function () {
+            this.timeout(0);
+            var controller = new AbortController();
+            return pages[0].renderToBufferAsync('png', 50, { signal: controller.signal }).then(function (out) {
+                controller.abort();
+                a.ok(out.data.length > 0);
+            });
+        });
+    });
+
+    describe('render budgets', function () {
+        it('should stop renders over operation budget', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { maxOperations: 1 });
+            }, function (err) {
+                return err.code === 'ERR_RENDER_OPERATION_LIMIT';
+            });
+            return pages[0].renderToBufferAsync('png', 50, { maxOperations: 1 }).then(function () {
+                a.fail('render was not stopped');
+            }, function (err) {
+                a.equal(err.code, 'ERR_RENDER_OPERATION_LIMIT');
+            });
+        });
+        it('should stop renders over time budget', function () {
+            this.timeout(0);
+            return pages[0].renderToBufferAsync('png', 300, { maxRenderMs: 0.001 }).then(function () {
+                a.fail('render was not stopped');
+            }, function (err) {
+                a.equal(err.code, 'ERR_RENDER_TIME_LIMIT');
+            });
+        });
+        it('should render pages within budget', function () {
+            this.timeout(0);
+            var out = pages[0].renderToBuffer('png', 50, { maxRenderMs: 60000, maxOperations: 1e9 });
+            a.ok(out.data.length > 0);
+        });
+        it('should reject invalid budgets', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { maxOperations: -1 });
+            }, /'maxOperations' option value must be a positive integer/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50, { maxRenderMs: 'soon' });
+            }, /'maxRenderMs' option value must be a positive number/);
+        });
+    });
+
+    describe('render pool', function () {
+        var initial = poppler.getRenderPoolStats();
+        it('should resize render pool', function () {
+            this.timeout(0);
+            var stats = poppler.configureRenderPool({threads: 2});
+            a.equal(stats.threads, 2);
+            return pages[0].renderToBufferAsync('png', 50).then(function () {
+                a.ok(poppler.getRenderPoolStats().completed > initial.completed);
+            });
+        });
+        it('should reject renders over the queue limit', function () {
+            this.timeout(0);
+            poppler.configureRenderPool({threads: 1, maxQueueDepth: 1});
+            var promises = [];
+            for (var i = 0; i < 4; i++) {
+                promises.push(pages[0].renderToBufferAsync('png', 50).reflect());
+            }
+            return Promise.all(promises).then(function (results) {
+                var rejected = results.filter(function (r) {
+                    return r.isRejected() && r.reason().message === 'Render queue is full';
+                });
+                a.ok(rejected.length > 0);
+                a.ok(results[0].isFulfilled());
+            }).finally(function () {
+                poppler.configureRenderPool({threads: initial.threads, maxQueueDepth: 0});
+            });
+        });
+        it('should not apply options when one is invalid', function () {
+            var before = poppler.getRenderPoolStats();
+            a.throws(function () {
+                poppler.configureRenderPool({threads: before.threads + 1, maxQueueDepth: -1});
+            }, /'maxQueueDepth' option value must be a non-negative integer/);
+            a.equal(poppler.getRenderPoolStats().threads, before.threads);
+        });
+    });
 });
 
 describe('freeing', function () {